@@ -0,0 +1,505 @@
+// Copyright 2016 massanoori. All Rights Reserved.
+
+// Microbenchmarks of the engine-independent cloth solver.
+// Run with --benchmark_format=json (or --benchmark_out=<file>) to track results across commits.
+
+#include "AirMeshClothSolver.h"
+#include "AirMeshClothMeshBuilder.h"
+#include "AirMeshClothTestScene.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace
+{
+	const int32_t NumWarmUpSteps = 10;
+
+	/** Solver in a settled hanging state */
+	std::unique_ptr<FAirMeshClothSolver> CreateSolver(const FClothGridDesc& Grid, bool bReorderVertices = false, int32_t NumHierarchyLevels = 0)
+	{
+		auto Solver = CreateSceneSolver(Grid, bReorderVertices, NumHierarchyLevels);
+
+		auto Params = MakeStepParams(4);
+		for (int32_t Step = 0; Step < NumWarmUpSteps; Step++)
+		{
+			Solver->Step(Params);
+		}
+
+		return Solver;
+	}
+
+	void SetPerElementCounter(benchmark::State& State, const char* Name, size_t NumElements)
+	{
+		// Inverted iteration invariant rate reports seconds per element
+		State.counters[Name] = benchmark::Counter((double)NumElements,
+			benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+	}
+
+	void SetGridCounters(benchmark::State& State, const FClothGridDesc& Grid, const FAirMeshClothSolver& Solver)
+	{
+		State.counters["Vertices"] = (double)Solver.GetNumVertices();
+		State.counters["Edges"] = (double)Solver.GetEdges().size();
+		State.counters["AirTetrahedra"] = (double)Solver.GetAirTetrahedra().size();
+		State.counters["Layers"] = (double)Grid.NumLayers;
+	}
+
+	uint8_t PackNormalComponentPerVertex(float Value)
+	{
+		int32_t Packed = (int32_t)(Value * 127.5f + 127.5f);
+		return (uint8_t)(Packed < 0 ? 0 : (Packed > 255 ? 255 : Packed));
+	}
+
+	FClothPackedNormal PackNormalPerVertex(const float (&Vector)[3], uint8_t W)
+	{
+		return FClothPackedNormal{ PackNormalComponentPerVertex(Vector[0]), PackNormalComponentPerVertex(Vector[1]), PackNormalComponentPerVertex(Vector[2]), W };
+	}
+
+	void NormalizePerVertex(float (&Vector)[3])
+	{
+		const float SquareSum = Vector[0] * Vector[0] + Vector[1] * Vector[1] + Vector[2] * Vector[2];
+		const float Scale = SquareSum < 1.e-8f ? 0.0f : 1.0f / std::sqrt(SquareSum);
+		Vector[0] *= Scale;
+		Vector[1] *= Scale;
+		Vector[2] *= Scale;
+	}
+
+	/** Previous BuildClothMeshVertices(), which branches on borders of every vertex, kept as the baseline */
+	void BuildClothMeshVerticesPerVertex(const FClothGridDesc& Grid, const FClothVector* Positions, FClothMeshVertex* OutVertices)
+	{
+		const uint32_t ResolutionX = Grid.ResolutionX;
+		const uint32_t ResolutionY = Grid.ResolutionY;
+		const uint32_t NumVerticesPerLayer = Grid.GetNumVerticesPerLayer();
+		const int32_t NumVertices = NumVerticesPerLayer * Grid.NumLayers;
+
+		auto Accumulate = [Positions](float (&Tangent)[3], int32_t To, int32_t From)
+		{
+			Tangent[0] += Positions[To].X - Positions[From].X;
+			Tangent[1] += Positions[To].Y - Positions[From].Y;
+			Tangent[2] += Positions[To].Z - Positions[From].Z;
+		};
+
+		for (int32_t VertexIndex = 0; VertexIndex < NumVertices; VertexIndex++)
+		{
+			int32_t XIndex = (VertexIndex % NumVerticesPerLayer) % (ResolutionX + 1);
+			int32_t YIndex = (VertexIndex % NumVerticesPerLayer) / (ResolutionX + 1);
+
+			float TangentX[3] = { 0.0f, 0.0f, 0.0f };
+			float TangentY[3] = { 0.0f, 0.0f, 0.0f };
+
+			if (XIndex > 0)
+			{
+				Accumulate(TangentX, VertexIndex, VertexIndex - 1);
+			}
+			if (XIndex < (int32_t)ResolutionX)
+			{
+				Accumulate(TangentX, VertexIndex + 1, VertexIndex);
+			}
+			if (YIndex > 0)
+			{
+				Accumulate(TangentY, VertexIndex, VertexIndex - ResolutionX - 1);
+			}
+			if (YIndex < (int32_t)ResolutionY)
+			{
+				Accumulate(TangentY, VertexIndex + ResolutionX + 1, VertexIndex);
+			}
+
+			NormalizePerVertex(TangentX);
+			NormalizePerVertex(TangentY);
+
+			float TangentZ[3] =
+			{
+				TangentX[1] * TangentY[2] - TangentX[2] * TangentY[1],
+				TangentX[2] * TangentY[0] - TangentX[0] * TangentY[2],
+				TangentX[0] * TangentY[1] - TangentX[1] * TangentY[0],
+			};
+			NormalizePerVertex(TangentZ);
+
+			OutVertices[VertexIndex] = FClothMeshVertex{ Positions[VertexIndex], PackNormalPerVertex(TangentX, 128), PackNormalPerVertex(TangentZ, 255) };
+		}
+	}
+
+	void RunBuildClothMesh(benchmark::State& State, const std::function<void(const FClothGridDesc&, const FClothVector*, FClothMeshVertex*)>& Build)
+	{
+		auto Grid = MakeGridDesc((int32_t)State.range(0), (int32_t)State.range(1));
+		auto Solver = CreateSolver(Grid);
+
+		// The render thread receives local space positions, which are world space here
+		std::vector<FClothVector> Positions(Solver->GetNumVertices());
+		Solver->CopyPositions(Positions.data());
+		std::vector<FClothMeshVertex> Vertices(Positions.size());
+
+		for (auto _ : State)
+		{
+			Build(Grid, Positions.data(), Vertices.data());
+			benchmark::DoNotOptimize(Vertices.data());
+			benchmark::ClobberMemory();
+		}
+
+		SetGridCounters(State, Grid, *Solver);
+		SetPerElementCounter(State, "PerVertex", Vertices.size());
+		State.SetItemsProcessed(State.iterations() * Vertices.size());
+		State.SetBytesProcessed(State.iterations() * Vertices.size() * sizeof(FClothMeshVertex));
+	}
+}
+
+static void BM_Integrate(benchmark::State& State)
+{
+	auto Grid = MakeGridDesc((int32_t)State.range(0), (int32_t)State.range(1));
+	auto Solver = CreateSolver(Grid);
+	auto Params = MakeStepParams(0);
+
+	for (auto _ : State)
+	{
+		Solver->Integrate(Params);
+		benchmark::DoNotOptimize(Solver->GetPositionBuffer().X.data());
+		benchmark::ClobberMemory();
+	}
+
+	SetGridCounters(State, Grid, *Solver);
+	SetPerElementCounter(State, "PerVertex", Solver->GetNumVertices());
+	State.SetItemsProcessed(State.iterations() * Solver->GetNumVertices());
+}
+
+static void BM_EvaluateForceFields(benchmark::State& State)
+{
+	auto Grid = MakeGridDesc((int32_t)State.range(0), (int32_t)State.range(1));
+	auto Solver = CreateSolver(Grid);
+
+	// Turbulence and a radial force over the whole cloth
+	const FClothForceField Fields[] =
+	{
+		FClothForceField::MakeTurbulence(500.0f, 200.0f, 1.0f),
+		FClothForceField::MakeRadial(FClothVector{ 0.0f, 0.0f, 0.0f }, 1000.0f, 1000.0f),
+	};
+	Solver->SetForceFields(Fields, 2);
+
+	for (auto _ : State)
+	{
+		Solver->EvaluateForceFields(1.0f / 60.0f);
+		benchmark::ClobberMemory();
+	}
+
+	SetGridCounters(State, Grid, *Solver);
+	SetPerElementCounter(State, "PerVertex", Solver->GetNumVertices());
+	State.SetItemsProcessed(State.iterations() * Solver->GetNumVertices());
+}
+
+static void BM_ProjectEdgeConstraints(benchmark::State& State)
+{
+	auto Grid = MakeGridDesc((int32_t)State.range(0), (int32_t)State.range(1));
+	auto Solver = CreateSolver(Grid, State.range(2) != 0);
+
+	for (auto _ : State)
+	{
+		Solver->ProjectEdgeConstraints();
+		benchmark::DoNotOptimize(Solver->GetPositionBuffer().X.data());
+		benchmark::ClobberMemory();
+	}
+
+	SetGridCounters(State, Grid, *Solver);
+	State.counters["Reordered"] = (double)State.range(2);
+	SetPerElementCounter(State, "PerConstraint", Solver->GetEdges().size());
+	State.SetItemsProcessed(State.iterations() * Solver->GetEdges().size());
+}
+
+static void BM_ProjectEdgeConstraintsParallel(benchmark::State& State)
+{
+	auto Grid = MakeGridDesc((int32_t)State.range(0), (int32_t)State.range(1));
+	auto Solver = CreateSolver(Grid);
+	Solver->SetParallelFor(MakeThreadParallelFor((int32_t)State.range(2)));
+
+	for (auto _ : State)
+	{
+		Solver->ProjectEdgeConstraints();
+		benchmark::DoNotOptimize(Solver->GetPositionBuffer().X.data());
+		benchmark::ClobberMemory();
+	}
+
+	SetGridCounters(State, Grid, *Solver);
+	State.counters["Threads"] = (double)State.range(2);
+	State.counters["EdgeColors"] = (double)Solver->GetNumEdgeColors();
+	SetPerElementCounter(State, "PerConstraint", Solver->GetEdges().size());
+	State.SetItemsProcessed(State.iterations() * Solver->GetEdges().size());
+}
+
+static void BM_ProjectEdgeConstraintsJacobi(benchmark::State& State)
+{
+	auto Grid = MakeGridDesc((int32_t)State.range(0), (int32_t)State.range(1));
+	auto Solver = CreateSolver(Grid);
+	Solver->SetParallelFor(MakeThreadParallelFor((int32_t)State.range(2)));
+
+	for (auto _ : State)
+	{
+		Solver->ProjectEdgeConstraintsJacobi();
+		benchmark::DoNotOptimize(Solver->GetPositionBuffer().X.data());
+		benchmark::ClobberMemory();
+	}
+
+	SetGridCounters(State, Grid, *Solver);
+	State.counters["Threads"] = (double)State.range(2);
+	SetPerElementCounter(State, "PerConstraint", Solver->GetEdges().size());
+	State.SetItemsProcessed(State.iterations() * Solver->GetEdges().size());
+}
+
+static void BM_ProjectAirTetrahedra(benchmark::State& State)
+{
+	auto Grid = MakeGridDesc((int32_t)State.range(0), (int32_t)State.range(1));
+	auto Solver = CreateSolver(Grid, State.range(2) != 0);
+
+	for (auto _ : State)
+	{
+		Solver->ProjectAirTetrahedra();
+		benchmark::DoNotOptimize(Solver->GetPositionBuffer().X.data());
+		benchmark::ClobberMemory();
+	}
+
+	SetGridCounters(State, Grid, *Solver);
+	State.counters["Reordered"] = (double)State.range(2);
+	SetPerElementCounter(State, "PerConstraint", Solver->GetAirTetrahedra().size());
+	State.SetItemsProcessed(State.iterations() * Solver->GetAirTetrahedra().size());
+}
+
+// Settled cloth, which is the best case of culling. See BM_StepMoving for a moving cloth.
+static void BM_ProjectAirTetrahedraCulled(benchmark::State& State)
+{
+	auto Grid = MakeGridDesc((int32_t)State.range(0), (int32_t)State.range(1));
+	auto Solver = CreateSolver(Grid);
+	Solver->SetCullAirTetrahedra(true);
+
+	for (auto _ : State)
+	{
+		Solver->ProjectAirTetrahedra();
+		benchmark::DoNotOptimize(Solver->GetPositionBuffer().X.data());
+		benchmark::ClobberMemory();
+	}
+
+	// Per constraint time is against all air tetrahedra, to be compared with BM_ProjectAirTetrahedra
+	SetGridCounters(State, Grid, *Solver);
+	State.counters["ActiveAirTetrahedra"] = (double)Solver->GetNumActiveAirTetrahedra();
+	SetPerElementCounter(State, "PerConstraint", Solver->GetAirTetrahedra().size());
+	State.SetItemsProcessed(State.iterations() * Solver->GetAirTetrahedra().size());
+}
+
+// Whole steps of a cloth swung by its pinned vertices, with and without culling of air tetrahedra
+static void BM_StepMoving(benchmark::State& State)
+{
+	auto Grid = MakeGridDesc((int32_t)State.range(0), (int32_t)State.range(1));
+	auto Solver = CreateSolver(Grid);
+	Solver->SetCullAirTetrahedra(State.range(2) != 0);
+
+	auto Params = MakeStepParams(4);
+	int64_t NumActiveAirTetrahedra = 0;
+	int32_t StepIndex = 0;
+
+	for (auto _ : State)
+	{
+		// Pinned vertices are displaced relative to the last step, a few centimeters per step
+		const float Time = StepIndex++ * Params.DeltaTime;
+		Params.PinnedVertexTransform = FClothTransform::Identity();
+		Params.PinnedVertexTransform.M[0][3] = 60.0f * Params.DeltaTime * std::cos(Time * 4.0f);
+		Params.PinnedVertexTransform.M[2][3] = 40.0f * Params.DeltaTime * std::sin(Time * 3.0f);
+
+		Solver->Step(Params);
+		NumActiveAirTetrahedra += Solver->GetNumActiveAirTetrahedra();
+		benchmark::DoNotOptimize(Solver->GetPositionBuffer().X.data());
+		benchmark::ClobberMemory();
+	}
+
+	SetGridCounters(State, Grid, *Solver);
+	State.counters["Culled"] = (double)State.range(2);
+	State.counters["ActiveAirTetrahedra"] = State.iterations() > 0 ? (double)NumActiveAirTetrahedra / State.iterations() : 0.0;
+	SetPerElementCounter(State, "PerVertex", Solver->GetNumVertices());
+}
+
+static void BM_ProjectAirTetrahedraParallel(benchmark::State& State)
+{
+	auto Grid = MakeGridDesc((int32_t)State.range(0), (int32_t)State.range(1));
+	auto Solver = CreateSolver(Grid);
+	Solver->SetParallelFor(MakeThreadParallelFor((int32_t)State.range(2)));
+
+	for (auto _ : State)
+	{
+		Solver->ProjectAirTetrahedra();
+		benchmark::DoNotOptimize(Solver->GetPositionBuffer().X.data());
+		benchmark::ClobberMemory();
+	}
+
+	SetGridCounters(State, Grid, *Solver);
+	State.counters["Threads"] = (double)State.range(2);
+	State.counters["AirTetrahedronColors"] = (double)Solver->GetNumAirTetrahedronColors();
+	SetPerElementCounter(State, "PerConstraint", Solver->GetAirTetrahedra().size());
+	State.SetItemsProcessed(State.iterations() * Solver->GetAirTetrahedra().size());
+}
+
+static void BM_ProjectAirTetrahedraJacobi(benchmark::State& State)
+{
+	auto Grid = MakeGridDesc((int32_t)State.range(0), (int32_t)State.range(1));
+	auto Solver = CreateSolver(Grid);
+	Solver->SetParallelFor(MakeThreadParallelFor((int32_t)State.range(2)));
+
+	for (auto _ : State)
+	{
+		Solver->ProjectAirTetrahedraJacobi();
+		benchmark::DoNotOptimize(Solver->GetPositionBuffer().X.data());
+		benchmark::ClobberMemory();
+	}
+
+	SetGridCounters(State, Grid, *Solver);
+	State.counters["Threads"] = (double)State.range(2);
+	SetPerElementCounter(State, "PerConstraint", Solver->GetAirTetrahedra().size());
+	State.SetItemsProcessed(State.iterations() * Solver->GetAirTetrahedra().size());
+}
+
+static void BM_BuildClothMesh(benchmark::State& State)
+{
+	RunBuildClothMesh(State, [](const FClothGridDesc& Grid, const FClothVector* Positions, FClothMeshVertex* OutVertices)
+	{
+		BuildClothMeshVertices(Grid, Positions, OutVertices);
+	});
+}
+
+static void BM_BuildClothMeshFastNormalize(benchmark::State& State)
+{
+	RunBuildClothMesh(State, [](const FClothGridDesc& Grid, const FClothVector* Positions, FClothMeshVertex* OutVertices)
+	{
+		BuildClothMeshVertices(Grid, Positions, OutVertices, true);
+	});
+}
+
+static void BM_BuildClothMeshPerVertex(benchmark::State& State)
+{
+	RunBuildClothMesh(State, BuildClothMeshVerticesPerVertex);
+}
+
+static void BM_BuildClothMeshParallel(benchmark::State& State)
+{
+	// Same task size as the scene proxy
+	const int32_t VerticesPerTask = 4096;
+	auto ParallelFor = MakeThreadParallelFor((int32_t)State.range(2));
+
+	RunBuildClothMesh(State, [&ParallelFor](const FClothGridDesc& Grid, const FClothVector* Positions, FClothMeshVertex* OutVertices)
+	{
+		const int32_t NumRows = (int32_t)Grid.GetNumRows();
+		const int32_t RowsPerTask = std::max(VerticesPerTask / (int32_t)(Grid.ResolutionX + 1), 1);
+		ParallelFor((NumRows + RowsPerTask - 1) / RowsPerTask, [&](int32_t TaskIndex)
+		{
+			const int32_t FirstRow = TaskIndex * RowsPerTask;
+			BuildClothMeshVertexRows(Grid, Positions, OutVertices, FirstRow, std::min(RowsPerTask, NumRows - FirstRow), true);
+		});
+	});
+	State.counters["Threads"] = (double)State.range(2);
+}
+
+static void BM_Step(benchmark::State& State)
+{
+	auto Grid = MakeGridDesc((int32_t)State.range(0), (int32_t)State.range(1));
+	auto Solver = CreateSolver(Grid);
+	auto Params = MakeStepParams((uint32_t)State.range(2));
+	Params.bUseJacobi = State.range(3) != 0;
+
+	for (auto _ : State)
+	{
+		Solver->Step(Params);
+		benchmark::DoNotOptimize(Solver->GetPositionBuffer().X.data());
+		benchmark::ClobberMemory();
+	}
+
+	SetGridCounters(State, Grid, *Solver);
+	State.counters["Iterations"] = (double)Params.NumIterations;
+	State.counters["Jacobi"] = Params.bUseJacobi ? 1.0 : 0.0;
+	SetPerElementCounter(State, "PerVertex", Solver->GetNumVertices());
+	State.SetItemsProcessed(State.iterations() * Solver->GetNumVertices());
+}
+
+/** Same step as BM_Step with coarse levels, 2 iterations each */
+static void BM_StepHierarchical(benchmark::State& State)
+{
+	auto Grid = MakeGridDesc((int32_t)State.range(0), 1);
+	auto Solver = CreateSolver(Grid, false, (int32_t)State.range(1));
+	auto Params = MakeStepParams((uint32_t)State.range(2));
+	Params.NumCoarseIterations = 2;
+	Params.bUseAirMesh = false;
+
+	for (auto _ : State)
+	{
+		Solver->Step(Params);
+		benchmark::DoNotOptimize(Solver->GetPositionBuffer().X.data());
+		benchmark::ClobberMemory();
+	}
+
+	SetGridCounters(State, Grid, *Solver);
+	State.counters["Levels"] = (double)Solver->GetNumHierarchyLevels();
+	State.counters["Iterations"] = (double)Params.NumIterations;
+	State.SetItemsProcessed(State.iterations() * Solver->GetNumVertices());
+}
+
+// Resolution (ResolutionX = ResolutionY), NumLayers
+static void StageArguments(benchmark::internal::Benchmark* Benchmark)
+{
+	Benchmark->ArgsProduct({ { 16, 64, 128, 256 }, { 1, 2, 4, 8, 16 } })->Unit(benchmark::kMicrosecond);
+}
+
+// Air tetrahedra exist only between layers
+static void AirMeshStageArguments(benchmark::internal::Benchmark* Benchmark)
+{
+	Benchmark->ArgsProduct({ { 16, 64, 128, 256 }, { 2, 4, 8, 16 } })->Unit(benchmark::kMicrosecond);
+}
+
+// Resolution, NumLayers, ReorderVertices
+static void OrderedStageArguments(benchmark::internal::Benchmark* Benchmark)
+{
+	Benchmark->ArgsProduct({ { 16, 64, 128, 256 }, { 1, 2, 4, 8, 16 }, { 0, 1 } })->Unit(benchmark::kMicrosecond);
+}
+
+static void OrderedAirMeshStageArguments(benchmark::internal::Benchmark* Benchmark)
+{
+	Benchmark->ArgsProduct({ { 16, 64, 128, 256 }, { 2, 4, 8, 16 }, { 0, 1 } })->Unit(benchmark::kMicrosecond);
+}
+
+// Resolution, NumLayers, NumThreads
+static void ParallelStageArguments(benchmark::internal::Benchmark* Benchmark)
+{
+	Benchmark->ArgsProduct({ { 64, 128, 256 }, { 2, 4, 16 }, { 1, 2, 4, 8 } })->Unit(benchmark::kMicrosecond)->UseRealTime();
+}
+
+// Resolution, NumLayers, NumIterations, Jacobi
+static void StepArguments(benchmark::internal::Benchmark* Benchmark)
+{
+	Benchmark->ArgsProduct({ { 16, 64, 128, 256 }, { 1, 4, 8, 16 }, { 1, 4, 16 }, { 0, 1 } })->Unit(benchmark::kMicrosecond);
+}
+
+// Resolution, NumLayers, Culled
+static void MovingStepArguments(benchmark::internal::Benchmark* Benchmark)
+{
+	Benchmark->ArgsProduct({ { 64, 128 }, { 4, 8 }, { 0, 1 } })->Unit(benchmark::kMicrosecond);
+}
+
+// Resolution, NumHierarchyLevels, NumIterations
+static void HierarchicalStepArguments(benchmark::internal::Benchmark* Benchmark)
+{
+	Benchmark->ArgsProduct({ { 64, 128, 256 }, { 0, 2, 4, 6 }, { 4, 16 } })->Unit(benchmark::kMicrosecond);
+}
+
+BENCHMARK(BM_Integrate)->Apply(StageArguments);
+BENCHMARK(BM_EvaluateForceFields)->Apply(StageArguments);
+BENCHMARK(BM_ProjectEdgeConstraints)->Apply(OrderedStageArguments);
+BENCHMARK(BM_ProjectEdgeConstraintsParallel)->Apply(ParallelStageArguments);
+BENCHMARK(BM_ProjectEdgeConstraintsJacobi)->Apply(ParallelStageArguments);
+BENCHMARK(BM_ProjectAirTetrahedra)->Apply(OrderedAirMeshStageArguments);
+BENCHMARK(BM_ProjectAirTetrahedraCulled)->Apply(AirMeshStageArguments);
+BENCHMARK(BM_StepMoving)->Apply(MovingStepArguments);
+BENCHMARK(BM_ProjectAirTetrahedraParallel)->Apply(ParallelStageArguments);
+BENCHMARK(BM_ProjectAirTetrahedraJacobi)->Apply(ParallelStageArguments);
+BENCHMARK(BM_BuildClothMesh)->Apply(StageArguments);
+BENCHMARK(BM_BuildClothMeshFastNormalize)->Apply(StageArguments);
+BENCHMARK(BM_BuildClothMeshPerVertex)->Apply(StageArguments);
+BENCHMARK(BM_BuildClothMeshParallel)->Apply(ParallelStageArguments);
+BENCHMARK(BM_Step)->Apply(StepArguments);
+BENCHMARK(BM_StepHierarchical)->Apply(HierarchicalStepArguments);
+
+BENCHMARK_MAIN();
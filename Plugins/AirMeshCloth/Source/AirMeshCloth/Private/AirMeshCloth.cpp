@@ -2,6 +2,9 @@
 
 #include "AirMeshClothPrivatePCH.h"
 #include "AirMeshClothLog.h"
+#include "AirMeshClothCustomVersion.h"
+#include "AirMeshClothStats.h"
+#include "Serialization/CustomVersion.h"
 
 
 class FAirMeshCloth : public IAirMeshCloth
@@ -28,3 +31,15 @@ void FAirMeshCloth::ShutdownModule()
 }
 
 DEFINE_LOG_CATEGORY(LogAirMeshCloth);
+
+DEFINE_STAT(STAT_AirMeshClothLODFull);
+DEFINE_STAT(STAT_AirMeshClothLODReduced);
+DEFINE_STAT(STAT_AirMeshClothLODLow);
+DEFINE_STAT(STAT_AirMeshClothLODFrozen);
+DEFINE_STAT(STAT_AirMeshClothSleeping);
+DEFINE_STAT(STAT_AirMeshClothIterations);
+
+const FGuid FAirMeshClothCustomVersion::GUID(0x6D3A41C2, 0x9E0B4F57, 0xA1C84D2E, 0x3B7F905A);
+
+// Register the custom version with core
+FCustomVersionRegistration GRegisterAirMeshClothCustomVersion(FAirMeshClothCustomVersion::GUID, FAirMeshClothCustomVersion::LatestVersion, TEXT("AirMeshClothVer"));
@@ -0,0 +1,74 @@
+// Copyright 2016 massanoori. All Rights Reserved.
+
+#pragma once
+
+// Engine-independent, same as AirMeshClothSolver.h.
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Greedy graph coloring of constraints, two constraints conflict when they share a vertex.
+ * Constraints are reordered so that each color is contiguous, and keep their relative order within a color.
+ *
+ * @param Constraints Constraints to be reordered
+ * @param NumVertices Number of vertices referred by constraints
+ * @param OutColorOffsets Start of each color in Constraints, followed by Constraints.size()
+ * @param GetVertexIndex Returns the Index-th vertex of a constraint, (const ConstraintType&, int32_t Index) -> int32_t
+ */
+template <int32_t NumConstraintVertices, typename ConstraintType, typename VertexIndexGetterType>
+void ColorConstraints(std::vector<ConstraintType>& Constraints, int32_t NumVertices, std::vector<int32_t>& OutColorOffsets, VertexIndexGetterType GetVertexIndex)
+{
+	std::vector<ConstraintType> Colored;
+	Colored.reserve(Constraints.size());
+
+	std::vector<int32_t> Remaining(Constraints.size());
+	for (size_t ConstraintIndex = 0; ConstraintIndex < Constraints.size(); ConstraintIndex++)
+	{
+		Remaining[ConstraintIndex] = (int32_t)ConstraintIndex;
+	}
+
+	// Last color which has taken each vertex
+	std::vector<int32_t> VertexColors(NumVertices, -1);
+	std::vector<int32_t> Deferred;
+
+	OutColorOffsets.clear();
+	OutColorOffsets.push_back(0);
+
+	for (int32_t Color = 0; !Remaining.empty(); Color++)
+	{
+		Deferred.clear();
+
+		for (int32_t ConstraintIndex : Remaining)
+		{
+			const auto& Constraint = Constraints[ConstraintIndex];
+
+			bool bConflicts = false;
+			for (int32_t Vertex = 0; Vertex < NumConstraintVertices; Vertex++)
+			{
+				if (VertexColors[GetVertexIndex(Constraint, Vertex)] == Color)
+				{
+					bConflicts = true;
+					break;
+				}
+			}
+
+			if (bConflicts)
+			{
+				Deferred.push_back(ConstraintIndex);
+				continue;
+			}
+
+			for (int32_t Vertex = 0; Vertex < NumConstraintVertices; Vertex++)
+			{
+				VertexColors[GetVertexIndex(Constraint, Vertex)] = Color;
+			}
+			Colored.push_back(Constraint);
+		}
+
+		OutColorOffsets.push_back((int32_t)Colored.size());
+		Remaining.swap(Deferred);
+	}
+
+	Constraints.swap(Colored);
+}
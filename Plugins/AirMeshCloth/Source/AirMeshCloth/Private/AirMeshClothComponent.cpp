@@ -6,65 +6,134 @@
 #include "EngineGlobals.h"
 #include "Engine/Engine.h"
 #include "LocalVertexFactory.h"
+#include "Async/ParallelFor.h"
 #include "AirMeshGen.h"
+#include "AirMeshClothMeshBuilder.h"
 #include "AirMeshClothLog.h"
+#include "AirMeshClothCustomVersion.h"
+#include "AirMeshClothManager.h"
+#include "AirMeshClothStats.h"
+#include "GameFramework/PlayerController.h"
+#include "Camera/PlayerCameraManager.h"
 
 struct FAirMeshClothDynamicData
 {
 	TArray<FVector> SimulatedPositions;
 };
 
+// Vertices built by each task on the render thread, see FAirMeshClothSceneProxy::BuildClothMesh()
+static const int32 VerticesPerBuildTask = 4096;
+
+// Positions and tangents, rewritten every frame
 class FAirMeshClothVertexBuffer : public FVertexBuffer
 {
 public:
 	virtual void InitRHI() override
 	{
 		FRHIResourceCreateInfo CreateInfo;
-		VertexBufferRHI = RHICreateVertexBuffer(NumVertices * sizeof(FDynamicMeshVertex), BUF_Dynamic, CreateInfo);
+		VertexBufferRHI = RHICreateVertexBuffer(NumVertices * sizeof(FClothMeshVertex), BUF_Dynamic, CreateInfo);
 	}
 
 	uint32 NumVertices;
 };
 
-class FAirMeshClothIndexBuffer : public FIndexBuffer
+// Texture coordinates and colors, which are constant for the grid
+class FAirMeshClothStaticVertexBuffer : public FVertexBuffer
 {
 public:
 	virtual void InitRHI() override
 	{
+		const uint32 Size = Vertices.Num() * sizeof(FClothMeshStaticVertex);
+
 		FRHIResourceCreateInfo CreateInfo;
-		IndexBufferRHI = RHICreateIndexBuffer(sizeof(uint32), NumIndices * sizeof(uint32), BUF_Dynamic, CreateInfo);
+		VertexBufferRHI = RHICreateVertexBuffer(Size, BUF_Static, CreateInfo);
+
+		void* BufferData = RHILockVertexBuffer(VertexBufferRHI, 0, Size, RLM_WriteOnly);
+		FMemory::Memcpy(BufferData, Vertices.GetData(), Size);
+		RHIUnlockVertexBuffer(VertexBufferRHI);
 	}
-	
-	uint32 NumIndices;
+
+	// Kept to initialize again when RHI resources are recreated
+	TArray<FClothMeshStaticVertex> Vertices;
 };
 
-void GenerateIndexBufferContent(uint32 ResolutionX, uint32 ResolutionY, uint32 NumLayers, TArray<int32>& OutIndices)
+// Grid topology never changes, so indices are uploaded once and only vertices are dynamic
+class FAirMeshClothIndexBuffer : public FIndexBuffer
 {
-	// build index buffer content
-	OutIndices.Empty(ResolutionX * ResolutionY * 2 * 3 * NumLayers);
-	uint32 NumVerticesPerLayer = (ResolutionX + 1) * (ResolutionY + 1);
-	for (uint32 Layer = 0; Layer < NumLayers; Layer++)
+public:
+	virtual void InitRHI() override
 	{
-		uint32 BaseIndex = Layer * NumVerticesPerLayer;
-		for (uint32 YIndex = 0; YIndex < ResolutionY; YIndex++)
+		const bool b16BitIndices = NumVertices <= MAX_uint16 + 1u;
+		const uint32 Stride = b16BitIndices ? sizeof(uint16) : sizeof(uint32);
+		const uint32 Size = Indices.Num() * Stride;
+
+		FRHIResourceCreateInfo CreateInfo;
+		IndexBufferRHI = RHICreateIndexBuffer(Stride, Size, BUF_Static, CreateInfo);
+
+		void* BufferData = RHILockIndexBuffer(IndexBufferRHI, 0, Size, RLM_WriteOnly);
+		if (b16BitIndices)
 		{
-			for (uint32 XIndex = 0; XIndex < ResolutionX; XIndex++)
+			uint16* Dest = static_cast<uint16*>(BufferData);
+			for (int32 Index = 0; Index < Indices.Num(); Index++)
 			{
-				int32 I00 = BaseIndex + YIndex * (ResolutionX + 1) + XIndex;
-				int32 I01 = BaseIndex + YIndex * (ResolutionX + 1) + XIndex + 1;
-				int32 I10 = BaseIndex + (YIndex + 1) * (ResolutionX + 1) + XIndex;
-				int32 I11 = BaseIndex + (YIndex + 1) * (ResolutionX + 1) + XIndex + 1;
-
-				OutIndices.Add(I00);
-				OutIndices.Add(I01);
-				OutIndices.Add(I10);
-
-				OutIndices.Add(I01);
-				OutIndices.Add(I11);
-				OutIndices.Add(I10);
+				Dest[Index] = (uint16)Indices[Index];
 			}
 		}
+		else
+		{
+			FMemory::Memcpy(BufferData, Indices.GetData(), Size);
+		}
+		RHIUnlockIndexBuffer(IndexBufferRHI);
+	}
+
+	// Kept to initialize again when RHI resources are recreated
+	TArray<int32> Indices;
+	uint32 NumVertices;
+};
+
+void GenerateIndexBufferContent(uint32 ResolutionX, uint32 ResolutionY, uint32 NumLayers, TArray<int32>& OutIndices)
+{
+	FClothGridDesc Grid = {};
+	Grid.ResolutionX = ResolutionX;
+	Grid.ResolutionY = ResolutionY;
+	Grid.NumLayers = NumLayers;
+
+	std::vector<int32_t> Indices;
+	GenerateClothGridIndices(Grid, Indices);
+
+	OutIndices.Empty((int32)Indices.size());
+	OutIndices.Append(Indices.data(), (int32)Indices.size());
+}
+
+static_assert(sizeof(FClothVector) == sizeof(FVector), "FClothVector must have the same layout with FVector");
+static_assert(sizeof(FClothPackedNormal) == sizeof(FPackedNormal), "FClothPackedNormal must have the same layout with FPackedNormal");
+static_assert(sizeof(FClothMeshStaticVertex) == sizeof(FVector2D) + sizeof(FColor), "FClothMeshStaticVertex must not be padded");
+static_assert(sizeof(FClothTetrahedron) == sizeof(TStaticArray<int32, 4u>), "FClothTetrahedron must have the same layout with TStaticArray<int32, 4u>");
+
+static FClothTransform ToClothTransform(const FMatrix& Matrix)
+{
+	// FMatrix transforms row vectors, FClothTransform transforms column vectors
+	FClothTransform Result;
+	for (int32 Row = 0; Row < 3; Row++)
+	{
+		for (int32 Column = 0; Column < 4; Column++)
+		{
+			Result.M[Row][Column] = Matrix.M[Column][Row];
+		}
 	}
+	return Result;
+}
+
+static FBox CalcSolverBounds(const FAirMeshClothSolver& Solver)
+{
+	FBox Box(ForceInit);
+	if (Solver.GetNumVertices() > 0)
+	{
+		FClothVector Min, Max;
+		Solver.CalcBounds(Min, Max);
+		Box = FBox(FVector(Min.X, Min.Y, Min.Z), FVector(Max.X, Max.Y, Max.Z));
+	}
+	return Box;
 }
 
 // =================================================================================
@@ -76,20 +145,23 @@ class FAirMeshClothVertexFactory : public FLocalVertexFactory
 public:
 	FAirMeshClothVertexFactory() {}
 
-	void Init(const FAirMeshClothVertexBuffer* VertexBuffer)
+	// Simulated attributes are read from VertexBuffer, constant ones from StaticVertexBuffer
+	void Init(const FAirMeshClothVertexBuffer* VertexBuffer, const FAirMeshClothStaticVertexBuffer* StaticVertexBuffer)
 	{
-		ENQUEUE_UNIQUE_RENDER_COMMAND_TWOPARAMETER(
+		ENQUEUE_UNIQUE_RENDER_COMMAND_THREEPARAMETER(
 			InitAirMeshClothVertexFactory,
 			FAirMeshClothVertexFactory*, VertexFactory, this,
 			const FAirMeshClothVertexBuffer*, VertexBuffer, VertexBuffer,
+			const FAirMeshClothStaticVertexBuffer*, StaticVertexBuffer, StaticVertexBuffer,
 		{
 			FDataType NewData;
-			NewData.PositionComponent = STRUCTMEMBER_VERTEXSTREAMCOMPONENT(VertexBuffer, FDynamicMeshVertex, Position, VET_Float3);
+			NewData.PositionComponent = STRUCTMEMBER_VERTEXSTREAMCOMPONENT(VertexBuffer, FClothMeshVertex, Position, VET_Float3);
+			NewData.TangentBasisComponents[0] = STRUCTMEMBER_VERTEXSTREAMCOMPONENT(VertexBuffer, FClothMeshVertex, TangentX, VET_PackedNormal);
+			NewData.TangentBasisComponents[1] = STRUCTMEMBER_VERTEXSTREAMCOMPONENT(VertexBuffer, FClothMeshVertex, TangentZ, VET_PackedNormal);
 			NewData.TextureCoordinates.Add(
-				FVertexStreamComponent(VertexBuffer, STRUCT_OFFSET(FDynamicMeshVertex, TextureCoordinate), sizeof(FDynamicMeshVertex), VET_Float2)
+				FVertexStreamComponent(StaticVertexBuffer, STRUCT_OFFSET(FClothMeshStaticVertex, TextureCoordinate), sizeof(FClothMeshStaticVertex), VET_Float2)
 				);
-			NewData.TangentBasisComponents[0] = STRUCTMEMBER_VERTEXSTREAMCOMPONENT(VertexBuffer, FDynamicMeshVertex, TangentX, VET_PackedNormal);
-			NewData.TangentBasisComponents[1] = STRUCTMEMBER_VERTEXSTREAMCOMPONENT(VertexBuffer, FDynamicMeshVertex, TangentZ, VET_PackedNormal);
+			NewData.ColorComponent = STRUCTMEMBER_VERTEXSTREAMCOMPONENT(StaticVertexBuffer, FClothMeshStaticVertex, Color, VET_Color);
 			VertexFactory->SetData(NewData);
 		});
 	}
@@ -115,11 +187,17 @@ public:
 		, MaterialRelevance(Component->GetMaterialRelevance(GetScene().GetFeatureLevel()))
 	{
 		VertexBuffer.NumVertices = GetRequiredVertexCount() * NumLayers;
-		IndexBuffer.NumIndices = GetRequiredIndexCount() * NumLayers;
+		IndexBuffer.NumVertices = VertexBuffer.NumVertices;
+		GenerateIndexBufferContent(ResolutionX, ResolutionY, NumLayers, IndexBuffer.Indices);
+		check(IndexBuffer.Indices.Num() == GetRequiredIndexCount() * NumLayers);
+
+		StaticVertexBuffer.Vertices.SetNumUninitialized(VertexBuffer.NumVertices);
+		BuildClothMeshStaticVertices(GetGridDesc(), StaticVertexBuffer.Vertices.GetData());
 
-		VertexFactory.Init(&VertexBuffer);
+		VertexFactory.Init(&VertexBuffer, &StaticVertexBuffer);
 
 		BeginInitResource(&VertexBuffer);
+		BeginInitResource(&StaticVertexBuffer);
 		BeginInitResource(&IndexBuffer);
 		BeginInitResource(&VertexFactory);
 
@@ -138,6 +216,7 @@ public:
 	{
 		VertexFactory.ReleaseResource();
 		VertexBuffer.ReleaseResource();
+		StaticVertexBuffer.ReleaseResource();
 		IndexBuffer.ReleaseResource();
 		delete DynamicData;
 	}
@@ -162,20 +241,10 @@ public:
 		delete DynamicData;
 		DynamicData = InDynamicData;
 
-		TArray<FDynamicMeshVertex> Vertices;
-		TArray<int32> Indices;
-		BuildClothMesh(DynamicData->SimulatedPositions, Vertices, Indices);
-
-		check(Vertices.Num() == GetRequiredVertexCount() * NumLayers);
-		check(Indices.Num() == GetRequiredIndexCount() * NumLayers);
-
-		void* BufferData = RHILockVertexBuffer(VertexBuffer.VertexBufferRHI, 0, Vertices.Num() * sizeof(FDynamicMeshVertex), RLM_WriteOnly);
-		FMemory::Memcpy(BufferData, Vertices.GetData(), Vertices.Num() * sizeof(FDynamicMeshVertex));
+		// Vertices are built directly in the locked buffer, which is write-only, so each one is written once in order
+		void* BufferData = RHILockVertexBuffer(VertexBuffer.VertexBufferRHI, 0, VertexBuffer.NumVertices * sizeof(FClothMeshVertex), RLM_WriteOnly);
+		BuildClothMesh(DynamicData->SimulatedPositions, static_cast<FClothMeshVertex*>(BufferData));
 		RHIUnlockVertexBuffer(VertexBuffer.VertexBufferRHI);
-
-		BufferData = RHILockIndexBuffer(IndexBuffer.IndexBufferRHI, 0, Indices.Num() * sizeof(int32), RLM_WriteOnly);
-		FMemory::Memcpy(BufferData, Indices.GetData(), Indices.Num() * sizeof(int32));
-		RHIUnlockIndexBuffer(IndexBuffer.IndexBufferRHI);
 	}
 
 	virtual FPrimitiveViewRelevance GetViewRelevance(const FSceneView* View) const override
@@ -238,63 +307,36 @@ public:
 		}
 	}
 
-	void BuildClothMesh(const TArray<FVector>& Positions, TArray<FDynamicMeshVertex>& Vertices, TArray<int32>& Indices) const
+	FClothGridDesc GetGridDesc() const
+	{
+		FClothGridDesc Grid = {};
+		Grid.ResolutionX = ResolutionX;
+		Grid.ResolutionY = ResolutionY;
+		Grid.NumLayers = NumLayers;
+		return Grid;
+	}
+
+	/** Builds vertices of all layers to OutVertices, which must have room for VertexBuffer.NumVertices elements */
+	void BuildClothMesh(const TArray<FVector>& Positions, FClothMeshVertex* OutVertices) const
 	{
 		QUICK_SCOPE_CYCLE_COUNTER(STAT_AirMeshClothProxy_BuildClothMesh);
 
-		Vertices.Empty(GetRequiredVertexCount() * NumLayers);
+		check(Positions.Num() == GetRequiredVertexCount() * NumLayers);
 
-		uint32 NumVerticesPerLayer = (ResolutionX + 1) * (ResolutionY + 1);
+		// Blocks of rows are built on worker threads, so the render thread waits less as layers and resolution grow.
+		// Small cloths are built inline, where tasks would cost more than they save.
+		const FClothGridDesc Grid = GetGridDesc();
+		const FClothVector* SourcePositions = reinterpret_cast<const FClothVector*>(Positions.GetData());
+		const int32 NumRows = Grid.GetNumRows();
+		const int32 RowsPerTask = FMath::Max(VerticesPerBuildTask / (int32)(ResolutionX + 1), 1);
+		const int32 NumTasks = FMath::DivideAndRoundUp(NumRows, RowsPerTask);
 
-		// Copy vertices to content of vertex buffer
-		for (int32 VertexIndex = 0; VertexIndex < Positions.Num(); VertexIndex++)
+		// Tangents are packed to 8 bits per component, so approximate normalization is precise enough
+		ParallelFor(NumTasks, [&Grid, SourcePositions, OutVertices, NumRows, RowsPerTask](int32 TaskIndex)
 		{
-			Vertices.AddUninitialized();
-			auto& AddedVertex = Vertices.Last();
-			AddedVertex.Position = Positions[VertexIndex];
-
-			int32 XIndex = (VertexIndex % NumVerticesPerLayer) % (ResolutionX + 1);
-			int32 YIndex = (VertexIndex % NumVerticesPerLayer) / (ResolutionX + 1);
-
-			float UFrac = XIndex / (float)ResolutionX;
-			float VFrac = YIndex / (float)ResolutionY;
-
-			AddedVertex.TextureCoordinate = FVector2D(UFrac, VFrac);
-			AddedVertex.Color = FColor(255, 255, 255);
-
-			// Compute tangents
-
-			FVector TangentX(0.0f);
-			FVector TangentY(0.0f);
-
-			if (XIndex > 0)
-			{
-				TangentX += Positions[VertexIndex] - Positions[VertexIndex - 1];
-			}
-			if (XIndex < (int32)ResolutionX)
-			{
-				TangentX += Positions[VertexIndex + 1] - Positions[VertexIndex];
-			}
-			if (YIndex > 0)
-			{
-				TangentY += Positions[VertexIndex] - Positions[VertexIndex - ResolutionX - 1];
-			}
-			if (YIndex < (int32)ResolutionY)
-			{
-				TangentY += Positions[VertexIndex + ResolutionX + 1] - Positions[VertexIndex];
-			}
-
-			TangentX = TangentX.GetSafeNormal();
-			TangentY = TangentY.GetSafeNormal();
-
-			AddedVertex.SetTangents(
-				TangentX,
-				TangentY,
-				FVector::CrossProduct(TangentX, TangentY).GetSafeNormal());
-		}
-
-		// Build index buffer content
-		GenerateIndexBufferContent(ResolutionX, ResolutionY, NumLayers, Indices);
+			const int32 FirstRow = TaskIndex * RowsPerTask;
+			BuildClothMeshVertexRows(Grid, SourcePositions, OutVertices, FirstRow, FMath::Min(RowsPerTask, NumRows - FirstRow), true);
+		}, NumTasks == 1);
 	}
 
 private:
@@ -305,6 +347,7 @@ private:
 	float LayerInterval;
 
 	FAirMeshClothVertexBuffer VertexBuffer;
+	FAirMeshClothStaticVertexBuffer StaticVertexBuffer;
 	FAirMeshClothIndexBuffer IndexBuffer;
 
 	FAirMeshClothVertexFactory VertexFactory;
@@ -327,10 +370,50 @@ UAirMeshClothComponent::UAirMeshClothComponent()
 	, SizeY(100.0f)
 	, NumLayers(1)
 	, NumIterations(4)
+	, StrainTolerance(0.0f)
+	, MinIterations(1)
 	, Damping(0.01f)
+	, NumHierarchyLevels(0)
+	, NumCoarseIterations(2)
+	, EdgeCompliance(0.0f)
+	, AirMeshCompliance(0.0f)
+	, ChebyshevSpectralRadius(0.0f)
+	, WindAcceleration(FVector::ZeroVector)
+	, TurbulenceAmplitude(0.0f)
+	, TurbulenceWavelength(200.0f)
+	, TurbulenceSpeed(1.0f)
+	, FixedTimestep(0.0f)
+	, MaxSubsteps(4)
 	, LayerInterval(5.0f)
 	, bUseAirMesh(true)
-	, CurrentPositionArrayIndex(0)
+	, bUseParallelSolver(true)
+	, bCullAirTetrahedra(true)
+	, bUseJacobiSolver(false)
+	, bReorderVertices(false)
+	, bSimulateAsync(false)
+	, bBatchSimulation(false)
+	, bEnableSleeping(false)
+	, SleepDisplacementThreshold(0.01f)
+	, SleepSteps(30)
+	, bEnableSimulationLOD(false)
+	, ReducedLODScreenSize(0.25f)
+	, LowLODScreenSize(0.1f)
+	, LowLODTickInterval(3)
+	, FreezeAfterNotRenderedTime(1.0f)
+	, LODHysteresis(0.2f)
+	, RenderInterpolationAlpha(1.0f)
+	, AsyncBounds(ForceInit)
+	, PublishedBounds(ForceInit)
+	, LastSimulationCycles(0)
+	, bRegisteredToBatch(false)
+	, bTickEnabledBeforeBatch(false)
+	, SimulationLOD(ESimulationLOD::Full)
+	, bSleeping(false)
+	, NumSettledSteps(0)
+	, LastStepDisplacement(0.0f)
+	, LastIterationDisplacement(0.0f)
+	, NumSkippedTicks(0)
+	, SkippedDeltaTime(0.0f)
 {
 	// Set this component to be initialized when the game starts, and to be ticked every frame.  You can turn these features
 	// off to improve performance if you don't need them.
@@ -349,113 +432,43 @@ void UAirMeshClothComponent::BeginPlay()
 }
 
 
+FClothGridDesc UAirMeshClothComponent::GetGridDesc() const
+{
+	FClothGridDesc Grid;
+	Grid.ResolutionX = ResolutionX;
+	Grid.ResolutionY = ResolutionY;
+	Grid.SizeX = SizeX;
+	Grid.SizeY = SizeY;
+	Grid.NumLayers = NumLayers;
+	Grid.LayerInterval = LayerInterval;
+	return Grid;
+}
+
 void UAirMeshClothComponent::OnRegister()
 {
 	Super::OnRegister();
 
-	GetCurrentPositionArray().Empty((ResolutionX + 1) * (ResolutionY + 1) * NumLayers);
-	SimulatedWeights.Empty((ResolutionX + 1) * (ResolutionY + 1) * NumLayers);
-	ClothEdges.Empty((
-		(ResolutionX + 1) * ResolutionY +
-		ResolutionX * (ResolutionY + 1) +
-		ResolutionX * ResolutionY * 2) * NumLayers);
-
-	for (uint32 Layer = 0; Layer < NumLayers; Layer++)
-	{
-		uint32 BaseVertexIndex = Layer * (ResolutionX + 1) * (ResolutionY + 1);
-
-		// Generate positions
-
-		for (uint32 YIndex = 0; YIndex < ResolutionY + 1; YIndex++)
-		{
-			for (uint32 XIndex = 0; XIndex < ResolutionX + 1; XIndex++)
-			{
-				GetCurrentPositionArray().AddUninitialized();
-				auto& AddedPosition = GetCurrentPositionArray().Last();
-
-				AddedPosition.X = XIndex * SizeX / ResolutionX - SizeX * 0.5f;
-				AddedPosition.Y = Layer * LayerInterval;
-				AddedPosition.Z = (ResolutionY - YIndex) * SizeY / ResolutionY - SizeY * 0.5f;
-
-				SimulatedWeights.Add(YIndex == 0 ? 0.0f : 1.0f);
-			}
-		}
-
-		// Generate edge length constraints
-
-		// horizontal
-		for (uint32 YIndex = 1 /* 0 */; YIndex < ResolutionY + 1; YIndex++)
-		{
-			for (uint32 XIndex = 0; XIndex < ResolutionX; XIndex++)
-			{
-				uint32 Base = YIndex * (ResolutionX + 1) + XIndex + BaseVertexIndex;
-				ClothEdges.AddUninitialized();
-				auto& Edge = ClothEdges.Last();
-				Edge.VertexIndices[0] = Base;
-				Edge.VertexIndices[1] = Base + 1;
-				Edge.Weights[0] = YIndex == 0 ? 0.0f : 1.0f;
-				Edge.Weights[1] = YIndex == 0 ? 0.0f : 1.0f;
-			}
-		}
+	WaitForSimulationTask();
 
-		// vertical
-		for (uint32 YIndex = 0; YIndex < ResolutionY; YIndex++)
-		{
-			for (uint32 XIndex = 0; XIndex < ResolutionX + 1; XIndex++)
-			{
-				uint32 Base = YIndex * (ResolutionX + 1) + XIndex + BaseVertexIndex;
-				ClothEdges.AddUninitialized();
-				auto& Edge = ClothEdges.Last();
-				Edge.VertexIndices[0] = Base;
-				Edge.VertexIndices[1] = Base + (ResolutionX + 1);
-				Edge.Weights[0] = YIndex == 0 ? 0.0f : 1.0f;
-				Edge.Weights[1] = YIndex + 1 == 0 ? 0.0f : 1.0f;
-			}
-		}
-
-		// cross
-		for (uint32 YIndex = 0; YIndex < ResolutionY; YIndex++)
-		{
-			for (uint32 XIndex = 0; XIndex < ResolutionX; XIndex++)
-			{
-				uint32 Base = YIndex * (ResolutionX + 1) + XIndex + BaseVertexIndex;
-
-				{
-					ClothEdges.AddUninitialized();
-					auto& Edge = ClothEdges.Last();
-					Edge.VertexIndices[0] = Base;
-					Edge.VertexIndices[1] = Base + (ResolutionX + 1) + 1;
-					Edge.Weights[0] = YIndex == 0 ? 0.0f : 1.0f;
-					Edge.Weights[1] = YIndex + 1 == 0 ? 0.0f : 1.0f;
-				}
-
-				{
-					ClothEdges.AddUninitialized();
-					auto& Edge = ClothEdges.Last();
-					Edge.VertexIndices[0] = Base + 1;
-					Edge.VertexIndices[1] = Base + (ResolutionX + 1);
-					Edge.Weights[0] = YIndex == 0 ? 0.0f : 1.0f;
-					Edge.Weights[1] = YIndex + 1 == 0 ? 0.0f : 1.0f;
-				}
-			}
-		}
-	}
+	// Generate positions and edge length constraints
+	Solver.SetReorderVertices(bReorderVertices);
+	Solver.SetNumHierarchyLevels(NumHierarchyLevels);
+	Solver.InitializeGrid(GetGridDesc());
 
 	// Transform positions
-
-	for (auto& Position : GetCurrentPositionArray())
-	{
-		Position = ComponentToWorld.TransformPosition(Position);
-	}
+	Solver.TransformPositions(ToClothTransform(ComponentToWorld.ToMatrixWithScale()));
 
 	PreviousTransform = ComponentToWorld;
+	TimeAccumulator.Reset();
+	RenderInterpolationAlpha = 1.0f;
+	SimulationLOD = ESimulationLOD::Full;
+	NumSkippedTicks = 0;
+	SkippedDeltaTime = 0.0f;
+	bSleeping = false;
+	NumSettledSteps = 0;
 
 	// Compute rest lengths
-	for (auto& Edge : ClothEdges)
-	{
-		auto Diff = GetCurrentPositionArray()[Edge.VertexIndices[0]] - GetCurrentPositionArray()[Edge.VertexIndices[1]];
-		Edge.RestLength = Diff.Size();
-	}
+	Solver.FinalizeRestState();
 
 	// Air mesh is generated only on UE4Editor
 	// On UE4Game, tetrahedra are precomputed and deserialized from FArchive
@@ -467,8 +480,14 @@ void UAirMeshClothComponent::OnRegister()
 		// Generate airmesh tetrahedra
 		TArray<int32> Indices;
 		GenerateIndexBufferContent(ResolutionX, ResolutionY, NumLayers, Indices);
-		GenerateAirMeshes(GetCurrentPositionArray(), Indices, AirTetrahedra);
-		UE_LOG(LogAirMeshCloth, Log, TEXT("# tetrahedra: %d"), AirTetrahedra.Num());
+
+		TArray<FVector> Positions;
+		Positions.SetNumUninitialized(Solver.GetNumVertices());
+		Solver.CopyPositions(reinterpret_cast<FClothVector*>(Positions.GetData()));
+
+		GenerateAirMeshes(Positions, Indices, AirTetrahedra);
+		ColorAirTetrahedra();
+		UE_LOG(LogAirMeshCloth, Log, TEXT("# tetrahedra: %d, # colors: %d"), AirTetrahedra.Num(), AirTetrahedronColorOffsets.Num() - 1);
 	}
 	else
 	{
@@ -476,24 +495,115 @@ void UAirMeshClothComponent::OnRegister()
 	}
 #endif
 
-	// Initialize previous positions with current positions
-	GetPreviousPositionArray() = GetCurrentPositionArray();
+	// Offsets are missing if tetrahedra have been neither generated nor loaded
+	if (AirTetrahedronColorOffsets.Num() == 0 || AirTetrahedronColorOffsets.Last() != AirTetrahedra.Num())
+	{
+		ColorAirTetrahedra();
+	}
+
+	Solver.SetAirTetrahedra(
+		reinterpret_cast<const FClothTetrahedron*>(AirTetrahedra.GetData()), AirTetrahedra.Num(),
+		AirTetrahedronColorOffsets.GetData(), AirTetrahedronColorOffsets.Num() - 1);
+
+	if (bUseParallelSolver)
+	{
+		Solver.SetParallelFor([](int32_t Num, const std::function<void(int32_t)>& Body)
+		{
+			ParallelFor(Num, [&Body](int32 Index) { Body(Index); });
+		});
+	}
+	else
+	{
+		Solver.SetParallelFor(FClothParallelFor());
+	}
+
+	Solver.SetCullAirTetrahedra(bCullAirTetrahedra);
+
+	// Published results are used while asynchronous simulation runs
+	PublishedRenderPositions.SetNumUninitialized(Solver.GetNumVertices());
+	Solver.CopyPositions(
+		reinterpret_cast<FClothVector*>(PublishedRenderPositions.GetData()),
+		ToClothTransform(ComponentToWorld.ToInverseMatrixWithScale()));
+	PublishedBounds = CalcSolverBounds(Solver);
+
+	if (bBatchSimulation && GetWorld() && GetWorld()->IsGameWorld())
+	{
+		FAirMeshClothManager::AddComponent(this);
+		bRegisteredToBatch = true;
+
+		// Stepped by the manager, so ticking would only return.
+		// Registration of the tick function would enable it if it starts with tick enabled, so it is restored to that state.
+		bTickEnabledBeforeBatch = PrimaryComponentTick.bStartWithTickEnabled || IsComponentTickEnabled();
+		SetComponentTickEnabled(false);
+	}
+}
+
+void UAirMeshClothComponent::OnUnregister()
+{
+	// The task refers to this component
+	WaitForSimulationTask();
+
+	if (bRegisteredToBatch)
+	{
+		FAirMeshClothManager::RemoveComponent(this);
+		bRegisteredToBatch = false;
+		SetComponentTickEnabled(bTickEnabledBeforeBatch);
+	}
+
+	Super::OnUnregister();
+}
+
+void UAirMeshClothComponent::RegisterComponentTickFunctions(bool bRegister)
+{
+	Super::RegisterComponentTickFunctions(bRegister);
+
+	// Tick functions are registered after OnRegister(), and enabled again if they start with tick enabled
+	if (bRegister && bRegisteredToBatch)
+	{
+		SetComponentTickEnabled(false);
+	}
 }
 
 FBoxSphereBounds UAirMeshClothComponent::CalcBounds(const FTransform & LocalToWorld) const
 {
-	FBox Box(GetCurrentPositionArray());
-	return FBoxSphereBounds(Box);
+	// The solver may be stepping on a worker thread
+	if (bSimulateAsync || bRegisteredToBatch)
+	{
+		return FBoxSphereBounds(PublishedBounds);
+	}
+
+	return FBoxSphereBounds(CalcSolverBounds(Solver));
+}
+
+void UAirMeshClothComponent::ColorAirTetrahedra()
+{
+	std::vector<int32_t> ColorOffsets;
+	ColorClothTetrahedra(reinterpret_cast<FClothTetrahedron*>(AirTetrahedra.GetData()), AirTetrahedra.Num(), ColorOffsets);
+
+	AirTetrahedronColorOffsets.Empty((int32)ColorOffsets.size());
+	AirTetrahedronColorOffsets.Append(ColorOffsets.data(), (int32)ColorOffsets.size());
 }
 
 void UAirMeshClothComponent::Serialize(FArchive & Ar)
 {
 	Super::Serialize(Ar);
 
+	Ar.UsingCustomVersion(FAirMeshClothCustomVersion::GUID);
+
 	if (Ar.IsFilterEditorOnly())
 	{
 		// Save tetrahedra for UE4Game and deserialize tetrahedra on UE4Game
 		Ar << AirTetrahedra;
+
+		if (Ar.CustomVer(FAirMeshClothCustomVersion::GUID) >= FAirMeshClothCustomVersion::AirTetrahedronColorOffsets)
+		{
+			Ar << AirTetrahedronColorOffsets;
+		}
+		else if (Ar.IsLoading())
+		{
+			// Saved before tetrahedra were colored
+			ColorAirTetrahedra();
+		}
 	}
 }
 
@@ -503,112 +613,284 @@ void UAirMeshClothComponent::TickComponent( float DeltaTime, ELevelTick TickType
 {
 	Super::TickComponent( DeltaTime, TickType, ThisTickFunction );
 
+	if (bRegisteredToBatch)
+	{
+		return;
+	}
+
 	QUICK_SCOPE_CYCLE_COUNTER(STAT_AirMeshClothComp_TickSimulation);
 
-	float ClampedDeltaTime = FMath::Clamp(DeltaTime, 0.0f, 1.0f / 30.0f);
+	// Publish the step started on the previous tick, also when switched to synchronous simulation
+	const bool bPublishesAsyncStep = SimulationTask.IsValid();
+	WaitForSimulationTask();
 
-	// Time integration
+	FClothStepParams Params;
+	if (!PrepareStep(DeltaTime, Params))
+	{
+		if (bPublishesAsyncStep)
+		{
+			MarkRenderDynamicDataDirty();
+			UpdateComponentToWorld();
+		}
+		return;
+	}
 
-	for (int32 VertexIndex = 0; VertexIndex < SimulatedPositions[0].Num(); VertexIndex++)
+	if (bSimulateAsync)
+	{
+		StartSimulationTask(Params);
+	}
+	else
 	{
-		auto CurrentPosition = GetCurrentPositionArray()[VertexIndex];
-		auto& PreviousPosition = GetPreviousPositionArray()[VertexIndex];
+		Solver.Step(Params);
 
-		if (SimulatedWeights[VertexIndex] == 0.0f)
+		if (bEnableSleeping)
 		{
-			PreviousPosition = PreviousTransform.InverseTransformPosition(CurrentPosition);
-			PreviousPosition = ComponentToWorld.TransformPosition(PreviousPosition);
+			LastStepDisplacement = Solver.CalcMaxStepDisplacement();
 		}
-		else
+		OnStepFinished();
+	}
+
+	// Need to send new data to render thread
+	MarkRenderDynamicDataDirty();
+
+	// Call this because bounds have changed
+	UpdateComponentToWorld();
+}
+
+bool UAirMeshClothComponent::PrepareStep(float DeltaTime, FClothStepParams& Params)
+{
+	if (bSleeping)
+	{
+		if (bEnableSleeping && ComponentToWorld.Equals(PreviousTransform))
 		{
-			auto Step = CurrentPosition - PreviousPosition;
-			PreviousPosition = CurrentPosition + Step * (1.0f - Damping) +
-				FVector(0.0f, 0.0f, 1.0f) * ClampedDeltaTime * ClampedDeltaTime * GetWorld()->GetGravityZ();
+			INC_DWORD_STAT(STAT_AirMeshClothSleeping);
+			return false;
 		}
+
+		WakeUp();
 	}
 
-	// Swap array
-	CurrentPositionArrayIndex ^= 1;
+	UpdateSimulationLOD();
 
-	PreviousTransform = ComponentToWorld;
+	if (SimulationLOD == ESimulationLOD::Frozen)
+	{
+		NumSkippedTicks = 0;
+		SkippedDeltaTime = 0.0f;
+		return false;
+	}
+
+	// Ticks skipped by the low LOD tier are stepped by the next step, even if the cloth has left the tier since
+	SkippedDeltaTime += DeltaTime;
+	if (++NumSkippedTicks < LowLODTickInterval && SimulationLOD == ESimulationLOD::Low)
+	{
+		return false;
+	}
 
-	// Enforce constraints
+	DeltaTime = SkippedDeltaTime;
+	const uint32 NumTicksToStep = NumSkippedTicks;
+	NumSkippedTicks = 0;
+	SkippedDeltaTime = 0.0f;
 
-	for (uint32 Iteration = 0; Iteration < NumIterations; Iteration++)
+	if (FixedTimestep > 0.0f)
 	{
-		// Length constraints
-		for (const auto& Edge : ClothEdges)
-		{
-			float WeightSum = Edge.Weights[0] + Edge.Weights[1];
-			
-			auto& V0 = GetCurrentPositionArray()[Edge.VertexIndices[0]];
-			auto& V1 = GetCurrentPositionArray()[Edge.VertexIndices[1]];
-
-			auto Diff = V1 - V0;
-			float CurrentLength = (V1 - V0).Size();
-			float Scale = (CurrentLength - Edge.RestLength) / (CurrentLength * WeightSum);
-			V0 += Diff * Scale * Edge.Weights[0];
-			V1 -= Diff * Scale * Edge.Weights[1];
-		}
+		Params.DeltaTime = FixedTimestep;
+		Params.NumSubsteps = TimeAccumulator.Advance(DeltaTime, FixedTimestep, MaxSubsteps);
+		RenderInterpolationAlpha = TimeAccumulator.GetAlpha(FixedTimestep);
+	}
+	else
+	{
+		// Each tick is clamped to 1/30, and ticks merged by the low LOD tier are split to substeps no longer than it
+		DeltaTime = FMath::Clamp(DeltaTime, 0.0f, NumTicksToStep / 30.0f);
+		Params.NumSubsteps = FMath::Max(FMath::CeilToInt(DeltaTime * 30.0f), 1);
+		Params.DeltaTime = DeltaTime / Params.NumSubsteps;
+		RenderInterpolationAlpha = 1.0f;
+	}
+	Params.GravityZ = GetWorld()->GetGravityZ();
+	Params.Damping = Damping;
+	Params.NumIterations = NumIterations;
+	Params.MinIterations = MinIterations;
+	Params.StrainTolerance = StrainTolerance;
+	Params.NumCoarseIterations = NumCoarseIterations;
+	Params.EdgeCompliance = EdgeCompliance;
+	Params.AirMeshCompliance = AirMeshCompliance;
+	Params.ChebyshevSpectralRadius = ChebyshevSpectralRadius;
+	Params.bUseAirMesh = bUseAirMesh;
+	Params.bUseJacobi = bUseJacobiSolver;
+
+	if (SimulationLOD != ESimulationLOD::Full)
+	{
+		Params.NumIterations = FMath::Max(NumIterations / 2, 1u);
+		Params.bUseAirMesh = false;
+	}
 
-		// Airmesh constraints
-		if (bUseAirMesh)
-		{
-			for (const auto& AirTet : AirTetrahedra)
-			{
-				auto& Positions = GetCurrentPositionArray();
+	// Solver space is world space
+	TArray<FClothForceField, TInlineAllocator<4>> ForceFields;
+	if (!WindAcceleration.IsZero())
+	{
+		ForceFields.Add(FClothForceField::MakeDirectional(FClothVector{ WindAcceleration.X, WindAcceleration.Y, WindAcceleration.Z }));
+	}
+	if (TurbulenceAmplitude > 0.0f)
+	{
+		ForceFields.Add(FClothForceField::MakeTurbulence(TurbulenceAmplitude, TurbulenceWavelength, TurbulenceSpeed));
+	}
+	Solver.SetForceFields(ForceFields.GetData(), ForceFields.Num());
 
-				auto& P0 = Positions[AirTet[0]];
-				auto& P1 = Positions[AirTet[1]];
-				auto& P2 = Positions[AirTet[2]];
-				auto& P3 = Positions[AirTet[3]];
+	// Radial forces are applied once, so kept until a step has a substep
+	if (Params.NumSubsteps > 0 && PendingRadialForces.Num() > 0)
+	{
+		Solver.SetFirstSubstepForceFields(PendingRadialForces.GetData(), PendingRadialForces.Num());
+		PendingRadialForces.Reset();
+	}
 
-				// Check negative volume
-				auto Grad0 = FVector::CrossProduct(P1 - P3, P2 - P3);
-				float Volume = FVector::DotProduct(P0 - P3, Grad0);
+	// Pinned vertices follow the component
+	Params.PinnedVertexTransform = ToClothTransform(PreviousTransform.ToInverseMatrixWithScale() * ComponentToWorld.ToMatrixWithScale());
 
-				if (Volume >= 0.0f)
-				{
-					continue;
-				}
+	// Otherwise pinned vertices catch up on the next step
+	if (Params.NumSubsteps > 0)
+	{
+		PreviousTransform = ComponentToWorld;
+	}
 
-				// Negating 2nd and 4th gradients
-				// based on an extraction formula of determinant
+	return true;
+}
 
-				auto Grad1 = -FVector::CrossProduct(P2 - P0, P3 - P0);
-				auto Grad2 = FVector::CrossProduct(P3 - P1, P0 - P1);
-				auto Grad3 = -FVector::CrossProduct(P0 - P2, P1 - P2);
+void UAirMeshClothComponent::UpdateSimulationLOD()
+{
+	if (!bEnableSimulationLOD)
+	{
+		SimulationLOD = ESimulationLOD::Full;
+	}
+	else if (GetWorld()->GetTimeSeconds() - LastRenderTime > FreezeAfterNotRenderedTime)
+	{
+		SimulationLOD = ESimulationLOD::Frozen;
+	}
+	else
+	{
+		// Coarser tiers are entered below their thresholds, and left above thresholds raised by hysteresis
+		const float ScreenSize = CalcScreenSize();
+		const float LowThreshold = LowLODScreenSize * (SimulationLOD >= ESimulationLOD::Low ? 1.0f + LODHysteresis : 1.0f);
+		const float ReducedThreshold = ReducedLODScreenSize * (SimulationLOD >= ESimulationLOD::Reduced ? 1.0f + LODHysteresis : 1.0f);
+
+		SimulationLOD =
+			ScreenSize < LowThreshold ? ESimulationLOD::Low :
+			ScreenSize < ReducedThreshold ? ESimulationLOD::Reduced :
+			ESimulationLOD::Full;
+	}
 
-				float Grad0SizeSq = Grad0.SizeSquared();
+	switch (SimulationLOD)
+	{
+	case ESimulationLOD::Full: INC_DWORD_STAT(STAT_AirMeshClothLODFull); break;
+	case ESimulationLOD::Reduced: INC_DWORD_STAT(STAT_AirMeshClothLODReduced); break;
+	case ESimulationLOD::Low: INC_DWORD_STAT(STAT_AirMeshClothLODLow); break;
+	case ESimulationLOD::Frozen: INC_DWORD_STAT(STAT_AirMeshClothLODFrozen); break;
+	}
+}
 
-				float Denominator =
-					SimulatedWeights[AirTet[0]] * Grad0SizeSq +
-					SimulatedWeights[AirTet[1]] * Grad1.SizeSquared() +
-					SimulatedWeights[AirTet[2]] * Grad2.SizeSquared() +
-					SimulatedWeights[AirTet[3]] * Grad3.SizeSquared();
+float UAirMeshClothComponent::CalcScreenSize() const
+{
+	// Bounds radius relative to the half width of the first player's view at the distance
+	APlayerController* PlayerController = GetWorld()->GetFirstPlayerController();
+	if (!PlayerController || !PlayerController->PlayerCameraManager)
+	{
+		return 1.0f;
+	}
 
-				if (FMath::IsNearlyZero(Denominator, Grad0SizeSq * 1e-7f))
-				{
-					continue;
-				}
+	const FVector ViewLocation = PlayerController->PlayerCameraManager->GetCameraLocation();
+	const float HalfFOV = FMath::DegreesToRadians(PlayerController->PlayerCameraManager->GetFOVAngle() * 0.5f);
+	const float Distance = FVector::Dist(Bounds.Origin, ViewLocation);
 
-				float ScalingFactor = Volume / Denominator;
+	return Bounds.SphereRadius / FMath::Max(Distance * FMath::Tan(HalfFOV), 1.0f);
+}
 
-				P0 -= SimulatedWeights[AirTet[0]] * ScalingFactor * Grad0;
-				P1 -= SimulatedWeights[AirTet[1]] * ScalingFactor * Grad1;
-				P2 -= SimulatedWeights[AirTet[2]] * ScalingFactor * Grad2;
-				P3 -= SimulatedWeights[AirTet[3]] * ScalingFactor * Grad3;
-			}
-		}
+void UAirMeshClothComponent::WakeUp()
+{
+	bSleeping = false;
+	NumSettledSteps = 0;
+}
+
+void UAirMeshClothComponent::AddRadialForce(FVector Origin, float Strength, float Radius)
+{
+	PendingRadialForces.Add(FClothForceField::MakeRadial(FClothVector{ Origin.X, Origin.Y, Origin.Z }, Strength, Radius));
+	WakeUp();
+}
+
+void UAirMeshClothComponent::OnStepFinished()
+{
+	LastIterationDisplacement = Solver.GetLastIterationDisplacement();
+	INC_DWORD_STAT_BY(STAT_AirMeshClothIterations, Solver.GetNumIterationsOfLastStep());
+	UpdateSleepState();
+}
+
+void UAirMeshClothComponent::UpdateSleepState()
+{
+	// Steps without substeps measure the last substep again, and count as the cloth has not moved
+	if (!bEnableSleeping || LastStepDisplacement > SleepDisplacementThreshold)
+	{
+		NumSettledSteps = 0;
+	}
+	else if (++NumSettledSteps >= SleepSteps)
+	{
+		bSleeping = true;
 	}
+}
 
-	// Need to send new data to render thread
-	MarkRenderDynamicDataDirty();
+void UAirMeshClothComponent::FinishStep()
+{
+	WaitForSimulationTask();
 
-	// Call this because bounds have changed
+	MarkRenderDynamicDataDirty();
 	UpdateComponentToWorld();
 }
 
+void UAirMeshClothComponent::StartSimulationTask(const FClothStepParams& Params)
+{
+	check(!SimulationTask.IsValid());
+
+	// Converted with the transform pinned vertices follow, so they stay attached to the component
+	const FClothTransform WorldToComponent = ToClothTransform(PreviousTransform.ToInverseMatrixWithScale());
+	const float Alpha = RenderInterpolationAlpha;
+
+	const bool bMeasureDisplacement = bEnableSleeping;
+
+	SimulationTask = FFunctionGraphTask::CreateAndDispatchWhenReady([this, Params, WorldToComponent, Alpha, bMeasureDisplacement]()
+	{
+		QUICK_SCOPE_CYCLE_COUNTER(STAT_AirMeshClothComp_AsyncSimulation);
+
+		const uint32 StartCycles = FPlatformTime::Cycles();
+
+		Solver.Step(Params);
+
+		AsyncRenderPositions.SetNumUninitialized(Solver.GetNumVertices());
+		Solver.CopyInterpolatedPositions(reinterpret_cast<FClothVector*>(AsyncRenderPositions.GetData()), WorldToComponent, Alpha);
+		AsyncBounds = CalcSolverBounds(Solver);
+
+		if (bMeasureDisplacement)
+		{
+			LastStepDisplacement = Solver.CalcMaxStepDisplacement();
+		}
+
+		LastSimulationCycles = FPlatformTime::Cycles() - StartCycles;
+	}, TStatId(), nullptr, ENamedThreads::AnyThread);
+}
+
+void UAirMeshClothComponent::WaitForSimulationTask()
+{
+	if (!SimulationTask.IsValid())
+	{
+		return;
+	}
+
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_AirMeshClothComp_WaitForSimulation);
+
+	FTaskGraphInterface::Get().WaitUntilTaskCompletes(SimulationTask, ENamedThreads::GameThread);
+	SimulationTask = nullptr;
+
+	Swap(AsyncRenderPositions, PublishedRenderPositions);
+	PublishedBounds = AsyncBounds;
+
+	OnStepFinished();
+}
+
 FPrimitiveSceneProxy * UAirMeshClothComponent::CreateSceneProxy()
 {
 	return new FAirMeshClothSceneProxy(this);
@@ -619,10 +901,20 @@ void UAirMeshClothComponent::SendRenderDynamicData_Concurrent()
 	if (SceneProxy)
 	{
 		auto DynamicData = new FAirMeshClothDynamicData();
-		DynamicData->SimulatedPositions = GetCurrentPositionArray();
-		for (auto& Position : DynamicData->SimulatedPositions)
+
+		if (bSimulateAsync || bRegisteredToBatch)
+		{
+			// Already converted by the task, which may be running now
+			DynamicData->SimulatedPositions = PublishedRenderPositions;
+		}
+		else
 		{
-			Position = ComponentToWorld.InverseTransformPosition(Position);
+			// Positions are converted to AoS in local space only here, by the transform pinned vertices follow
+			DynamicData->SimulatedPositions.SetNumUninitialized(Solver.GetNumVertices());
+			Solver.CopyInterpolatedPositions(
+				reinterpret_cast<FClothVector*>(DynamicData->SimulatedPositions.GetData()),
+				ToClothTransform(PreviousTransform.ToInverseMatrixWithScale()),
+				RenderInterpolationAlpha);
 		}
 
 		ENQUEUE_UNIQUE_RENDER_COMMAND_TWOPARAMETER(
@@ -0,0 +1,26 @@
+// Copyright 2016 massanoori. All Rights Reserved.
+
+#pragma once
+
+// Custom serialization version for data saved by UAirMeshClothComponent
+struct FAirMeshClothCustomVersion
+{
+	enum Type
+	{
+		// Before any version changes were made in the plugin
+		BeforeCustomVersionWasAdded = 0,
+
+		// Air tetrahedra are graph-colored and color offsets are saved with them
+		AirTetrahedronColorOffsets,
+
+		// -----<new versions can be added above this line>-------------------------------------------------
+		VersionPlusOne,
+		LatestVersion = VersionPlusOne - 1
+	};
+
+	// The GUID for this custom version number
+	const static FGuid GUID;
+
+private:
+	FAirMeshClothCustomVersion() {}
+};
@@ -0,0 +1,162 @@
+// Copyright 2016 massanoori. All Rights Reserved.
+
+#include "AirMeshClothPrivatePCH.h"
+#include "AirMeshClothManager.h"
+#include "AirMeshClothComponent.h"
+#include "AirMeshClothStats.h"
+
+DECLARE_CYCLE_STAT(TEXT("Batch Start"), STAT_AirMeshClothBatchStart, STATGROUP_AirMeshCloth);
+DECLARE_CYCLE_STAT(TEXT("Batch Wait"), STAT_AirMeshClothBatchWait, STATGROUP_AirMeshCloth);
+DECLARE_CYCLE_STAT(TEXT("Batch Finish"), STAT_AirMeshClothBatchFinish, STATGROUP_AirMeshCloth);
+DECLARE_CYCLE_STAT(TEXT("Batch Solve (sum of tasks)"), STAT_AirMeshClothBatchSolve, STATGROUP_AirMeshCloth);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Batched Cloths"), STAT_AirMeshClothBatchedComponents, STATGROUP_AirMeshCloth);
+
+TMap<UWorld*, FAirMeshClothManager*> FAirMeshClothManager::Managers;
+
+void FAirMeshClothBatchTickFunction::ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent)
+{
+	// Cloth components do not tick in editor viewports either
+	if (TickType == LEVELTICK_ViewportsOnly)
+	{
+		return;
+	}
+
+	if (bStartsBatch)
+	{
+		Manager->StartBatch(DeltaTime);
+	}
+	else
+	{
+		Manager->FinishBatch();
+	}
+}
+
+FString FAirMeshClothBatchTickFunction::DiagnosticMessage()
+{
+	return bStartsBatch ? TEXT("FAirMeshClothManager::StartBatch") : TEXT("FAirMeshClothManager::FinishBatch");
+}
+
+FAirMeshClothManager::FAirMeshClothManager(UWorld* InWorld)
+	: World(InWorld)
+{
+	StartTickFunction.Manager = this;
+	StartTickFunction.bStartsBatch = true;
+	StartTickFunction.TickGroup = TG_PrePhysics;
+	StartTickFunction.bCanEverTick = true;
+	StartTickFunction.RegisterTickFunction(World->PersistentLevel);
+
+	FinishTickFunction.Manager = this;
+	FinishTickFunction.bStartsBatch = false;
+	FinishTickFunction.TickGroup = TG_PostUpdateWork;
+	FinishTickFunction.bCanEverTick = true;
+	FinishTickFunction.RegisterTickFunction(World->PersistentLevel);
+}
+
+FAirMeshClothManager::~FAirMeshClothManager()
+{
+	StartTickFunction.UnRegisterTickFunction();
+	FinishTickFunction.UnRegisterTickFunction();
+}
+
+void FAirMeshClothManager::AddComponent(UAirMeshClothComponent* Component)
+{
+	UWorld* World = Component->GetWorld();
+	check(World);
+
+	FAirMeshClothManager*& Manager = Managers.FindOrAdd(World);
+	if (!Manager)
+	{
+		Manager = new FAirMeshClothManager(World);
+	}
+
+	Manager->Components.AddUnique(Component);
+
+	// Owners may move pinned vertices in their tick, which is the prerequisite of a component tick too
+	if (AActor* Owner = Component->GetOwner())
+	{
+		Manager->StartTickFunction.AddPrerequisite(Owner, Owner->PrimaryActorTick);
+	}
+}
+
+void FAirMeshClothManager::RemoveComponent(UAirMeshClothComponent* Component)
+{
+	for (auto It = Managers.CreateIterator(); It; ++It)
+	{
+		FAirMeshClothManager* Manager = It.Value();
+		if (Manager->Components.Remove(Component) == 0)
+		{
+			continue;
+		}
+
+		if (Manager->Components.Num() == 0)
+		{
+			delete Manager;
+			It.RemoveCurrent();
+			continue;
+		}
+
+		// Prerequisites are unique, so kept while another component of the owner remains
+		AActor* Owner = Component->GetOwner();
+		if (Owner && !Manager->Components.ContainsByPredicate([Owner](const UAirMeshClothComponent* Other) { return Other->GetOwner() == Owner; }))
+		{
+			Manager->StartTickFunction.RemovePrerequisite(Owner, Owner->PrimaryActorTick);
+		}
+	}
+}
+
+void FAirMeshClothManager::StartBatch(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_AirMeshClothBatchStart);
+
+	for (UAirMeshClothComponent* Component : Components)
+	{
+		// In case the previous batch has not been finished, e.g. by pause between tick groups
+		if (Component->SimulationTask.IsValid())
+		{
+			Component->FinishStep();
+		}
+
+		FClothStepParams Params;
+		if (Component->PrepareStep(DeltaTime, Params))
+		{
+			Component->StartSimulationTask(Params);
+		}
+	}
+
+	SET_DWORD_STAT(STAT_AirMeshClothBatchedComponents, Components.Num());
+}
+
+void FAirMeshClothManager::FinishBatch()
+{
+	{
+		SCOPE_CYCLE_COUNTER(STAT_AirMeshClothBatchWait);
+
+		FGraphEventArray Tasks;
+		for (UAirMeshClothComponent* Component : Components)
+		{
+			if (Component->SimulationTask.IsValid())
+			{
+				Tasks.Add(Component->SimulationTask);
+			}
+		}
+
+		FTaskGraphInterface::Get().WaitUntilTasksComplete(Tasks, ENamedThreads::GameThread);
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_AirMeshClothBatchFinish);
+
+	uint32 SolveCycles = 0;
+	for (UAirMeshClothComponent* Component : Components)
+	{
+		// Skipped by simulation LOD
+		if (!Component->SimulationTask.IsValid())
+		{
+			continue;
+		}
+
+		SolveCycles += Component->LastSimulationCycles;
+		Component->FinishStep();
+	}
+
+	SET_CYCLE_COUNTER(STAT_AirMeshClothBatchSolve, SolveCycles);
+}
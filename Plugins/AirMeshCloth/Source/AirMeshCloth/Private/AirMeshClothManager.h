@@ -0,0 +1,47 @@
+// Copyright 2016 massanoori. All Rights Reserved.
+
+#pragma once
+
+class UAirMeshClothComponent;
+class FAirMeshClothManager;
+
+/** Starts or finishes the batch of a manager */
+struct FAirMeshClothBatchTickFunction : public FTickFunction
+{
+	FAirMeshClothManager* Manager;
+	bool bStartsBatch;
+
+	virtual void ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent) override;
+	virtual FString DiagnosticMessage() override;
+};
+
+/**
+ * Steps all batched cloth components of a world together.
+ * Each component is stepped by its own task dispatched in TG_PrePhysics,
+ * and all tasks are joined at a single sync point in TG_PostUpdateWork.
+ * The batch starts after the primary ticks of all owners, same as component ticks.
+ * Created with the first batched component of a world, and destroyed with the last one.
+ */
+class FAirMeshClothManager
+{
+public:
+	static void AddComponent(UAirMeshClothComponent* Component);
+	static void RemoveComponent(UAirMeshClothComponent* Component);
+
+private:
+	explicit FAirMeshClothManager(UWorld* InWorld);
+	~FAirMeshClothManager();
+
+	void StartBatch(float DeltaTime);
+	void FinishBatch();
+
+	UWorld* World;
+	TArray<UAirMeshClothComponent*> Components;
+
+	FAirMeshClothBatchTickFunction StartTickFunction;
+	FAirMeshClothBatchTickFunction FinishTickFunction;
+
+	static TMap<UWorld*, FAirMeshClothManager*> Managers;
+
+	friend struct FAirMeshClothBatchTickFunction;
+};
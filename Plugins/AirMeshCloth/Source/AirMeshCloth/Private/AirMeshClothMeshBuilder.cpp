@@ -0,0 +1,152 @@
+// Copyright 2016 massanoori. All Rights Reserved.
+
+// Engine-independent on purpose, so the module's PCH is not included here.
+#include "AirMeshClothMeshBuilder.h"
+#include "AirMeshClothSimd.h"
+
+#include <algorithm>
+
+namespace
+{
+	// Vertices of a row processed at once, so scratch arrays fit on the stack
+	const int32_t TangentBlockSize = 64;
+
+	inline void SimdNormalize(FClothSimdFloat& X, FClothSimdFloat& Y, FClothSimdFloat& Z, bool bFastNormalize)
+	{
+		// Same tolerance as GetSafeNormal(), zero vectors stay zero
+		const FClothSimdFloat SquareSum = SimdAdd(SimdAdd(SimdMul(X, X), SimdMul(Y, Y)), SimdMul(Z, Z));
+		const FClothSimdFloat InverseSize = bFastNormalize ? SimdReciprocalSqrtApprox(SquareSum) : SimdDiv(SimdSet(1.0f), SimdSqrt(SquareSum));
+		const FClothSimdFloat Scale = SimdSelect(SimdCompareLess(SquareSum, SimdSet(1.e-8f)), SimdSet(0.0f), InverseSize);
+		X = SimdMul(X, Scale);
+		Y = SimdMul(Y, Scale);
+		Z = SimdMul(Z, Scale);
+	}
+
+	// Same mapping as FPackedNormal. Values are clamped here, and truncated by ToPackedComponent() after the vector loop.
+	inline void SimdStorePackedComponent(float* Destination, FClothSimdFloat Value)
+	{
+		const FClothSimdFloat Packed = SimdAdd(SimdMul(Value, SimdSet(127.5f)), SimdSet(127.5f));
+		SimdStore(Destination, SimdMin(SimdMax(Packed, SimdSet(0.0f)), SimdSet(255.0f)));
+	}
+
+	inline uint8_t ToPackedComponent(float Value)
+	{
+		return (uint8_t)(int32_t)Value;
+	}
+}
+
+void BuildClothMeshVertices(const FClothGridDesc& Grid, const FClothVector* Positions, FClothMeshVertex* OutVertices, bool bFastNormalize)
+{
+	BuildClothMeshVertexRows(Grid, Positions, OutVertices, 0, Grid.GetNumRows(), bFastNormalize);
+}
+
+void BuildClothMeshVertexRows(const FClothGridDesc& Grid, const FClothVector* Positions, FClothMeshVertex* OutVertices, int32_t FirstRow, int32_t NumRows, bool bFastNormalize)
+{
+	const int32_t ResolutionX = (int32_t)Grid.ResolutionX;
+	const int32_t ResolutionY = (int32_t)Grid.ResolutionY;
+	const int32_t RowLength = ResolutionX + 1;
+
+	// Row positions are shifted by one, with the first and last vertices repeated on both ends.
+	// Then central differences are one-sided on borders, same as summing both sides where they exist.
+	alignas(32) float RowX[TangentBlockSize + ClothSimdWidth + 2];
+	alignas(32) float RowY[TangentBlockSize + ClothSimdWidth + 2];
+	alignas(32) float RowZ[TangentBlockSize + ClothSimdWidth + 2];
+
+	// Differences between the next and the previous rows, and packed tangents before conversion to bytes
+	alignas(32) float DeltaY[3][TangentBlockSize];
+	alignas(32) float PackedX[3][TangentBlockSize];
+	alignas(32) float PackedZ[3][TangentBlockSize];
+
+	for (int32_t RowIndex = FirstRow; RowIndex < FirstRow + NumRows; RowIndex++)
+	{
+		// Rows of all layers are consecutive in memory
+		const int32_t YIndex = RowIndex % (ResolutionY + 1);
+		const int32_t RowBegin = RowIndex * RowLength;
+		const FClothVector* Row = Positions + RowBegin;
+		const FClothVector* PreviousRow = YIndex > 0 ? Row - RowLength : Row;
+		const FClothVector* NextRow = YIndex < ResolutionY ? Row + RowLength : Row;
+
+		for (int32_t BlockBegin = 0; BlockBegin < RowLength; BlockBegin += TangentBlockSize)
+		{
+			const int32_t BlockLength = std::min(RowLength - BlockBegin, TangentBlockSize);
+			const int32_t PaddedBlockLength = (BlockLength + ClothSimdWidth - 1) / ClothSimdWidth * ClothSimdWidth;
+
+			// Deinterleave to structure of arrays, lanes beyond the block repeat the last vertex
+			for (int32_t Index = 0; Index < PaddedBlockLength + 2; Index++)
+			{
+				const int32_t XIndex = std::min(std::max(BlockBegin + Index - 1, 0), ResolutionX);
+				RowX[Index] = Row[XIndex].X;
+				RowY[Index] = Row[XIndex].Y;
+				RowZ[Index] = Row[XIndex].Z;
+			}
+
+			for (int32_t Index = 0; Index < PaddedBlockLength; Index++)
+			{
+				const int32_t XIndex = std::min(BlockBegin + Index, ResolutionX);
+				DeltaY[0][Index] = NextRow[XIndex].X - PreviousRow[XIndex].X;
+				DeltaY[1][Index] = NextRow[XIndex].Y - PreviousRow[XIndex].Y;
+				DeltaY[2][Index] = NextRow[XIndex].Z - PreviousRow[XIndex].Z;
+			}
+
+			for (int32_t Index = 0; Index < PaddedBlockLength; Index += ClothSimdWidth)
+			{
+				FClothSimdFloat TangentXX = SimdSub(SimdLoadUnaligned(RowX + Index + 2), SimdLoadUnaligned(RowX + Index));
+				FClothSimdFloat TangentXY = SimdSub(SimdLoadUnaligned(RowY + Index + 2), SimdLoadUnaligned(RowY + Index));
+				FClothSimdFloat TangentXZ = SimdSub(SimdLoadUnaligned(RowZ + Index + 2), SimdLoadUnaligned(RowZ + Index));
+				FClothSimdFloat TangentYX = SimdLoad(DeltaY[0] + Index);
+				FClothSimdFloat TangentYY = SimdLoad(DeltaY[1] + Index);
+				FClothSimdFloat TangentYZ = SimdLoad(DeltaY[2] + Index);
+
+				SimdNormalize(TangentXX, TangentXY, TangentXZ, bFastNormalize);
+				SimdNormalize(TangentYX, TangentYY, TangentYZ, bFastNormalize);
+
+				// TangentZ is the normalized cross product, so the basis determinant is never negative
+				FClothSimdFloat NormalX = SimdSub(SimdMul(TangentXY, TangentYZ), SimdMul(TangentXZ, TangentYY));
+				FClothSimdFloat NormalY = SimdSub(SimdMul(TangentXZ, TangentYX), SimdMul(TangentXX, TangentYZ));
+				FClothSimdFloat NormalZ = SimdSub(SimdMul(TangentXX, TangentYY), SimdMul(TangentXY, TangentYX));
+				SimdNormalize(NormalX, NormalY, NormalZ, bFastNormalize);
+
+				SimdStorePackedComponent(PackedX[0] + Index, TangentXX);
+				SimdStorePackedComponent(PackedX[1] + Index, TangentXY);
+				SimdStorePackedComponent(PackedX[2] + Index, TangentXZ);
+				SimdStorePackedComponent(PackedZ[0] + Index, NormalX);
+				SimdStorePackedComponent(PackedZ[1] + Index, NormalY);
+				SimdStorePackedComponent(PackedZ[2] + Index, NormalZ);
+			}
+
+			// Each vertex is stored whole, since the destination may be write-combined memory
+			FClothMeshVertex* OutRow = OutVertices + RowBegin + BlockBegin;
+			for (int32_t Index = 0; Index < BlockLength; Index++)
+			{
+				OutRow[Index] = FClothMeshVertex{
+					Row[BlockBegin + Index],
+					FClothPackedNormal{ ToPackedComponent(PackedX[0][Index]), ToPackedComponent(PackedX[1][Index]), ToPackedComponent(PackedX[2][Index]), 128 },
+					FClothPackedNormal{ ToPackedComponent(PackedZ[0][Index]), ToPackedComponent(PackedZ[1][Index]), ToPackedComponent(PackedZ[2][Index]), 255 },
+				};
+			}
+		}
+	}
+}
+
+void BuildClothMeshStaticVertices(const FClothGridDesc& Grid, FClothMeshStaticVertex* OutVertices)
+{
+	const uint32_t ResolutionX = Grid.ResolutionX;
+	const uint32_t ResolutionY = Grid.ResolutionY;
+	const uint32_t NumVerticesPerLayer = Grid.GetNumVerticesPerLayer();
+	const int32_t NumVertices = NumVerticesPerLayer * Grid.NumLayers;
+
+	for (int32_t VertexIndex = 0; VertexIndex < NumVertices; VertexIndex++)
+	{
+		auto& AddedVertex = OutVertices[VertexIndex];
+
+		int32_t XIndex = (VertexIndex % NumVerticesPerLayer) % (ResolutionX + 1);
+		int32_t YIndex = (VertexIndex % NumVerticesPerLayer) / (ResolutionX + 1);
+
+		AddedVertex.TextureCoordinate[0] = XIndex / (float)ResolutionX;
+		AddedVertex.TextureCoordinate[1] = YIndex / (float)ResolutionY;
+		AddedVertex.Color[0] = 255;
+		AddedVertex.Color[1] = 255;
+		AddedVertex.Color[2] = 255;
+		AddedVertex.Color[3] = 255;
+	}
+}
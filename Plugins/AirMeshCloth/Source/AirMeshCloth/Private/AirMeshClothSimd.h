@@ -0,0 +1,113 @@
+// Copyright 2016 massanoori. All Rights Reserved.
+
+#pragma once
+
+// Thin SIMD wrappers for engine-independent kernels.
+// AVX is used when the compiler targets it (/arch:AVX, -mavx), SSE2 on other x86 targets, scalar code otherwise.
+// Every operation is lane-wise IEEE arithmetic, so all paths produce the same results as scalar code,
+// except SimdReciprocalSqrtApprox() whose precision depends on the instruction set.
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define AIRMESHCLOTH_SIMD_AVX 1
+#elif defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define AIRMESHCLOTH_SIMD_SSE 1
+#else
+#include <cmath>
+#define AIRMESHCLOTH_SIMD_SCALAR 1
+#endif
+
+#if AIRMESHCLOTH_SIMD_AVX
+
+typedef __m256 FClothSimdFloat;
+typedef __m256 FClothSimdMask;
+
+static const int ClothSimdWidth = 8;
+
+inline FClothSimdFloat SimdLoad(const float* Source) { return _mm256_load_ps(Source); }
+inline FClothSimdFloat SimdLoadUnaligned(const float* Source) { return _mm256_loadu_ps(Source); }
+inline void SimdStore(float* Destination, FClothSimdFloat Value) { _mm256_store_ps(Destination, Value); }
+inline FClothSimdFloat SimdSet(float Value) { return _mm256_set1_ps(Value); }
+inline FClothSimdFloat SimdAdd(FClothSimdFloat A, FClothSimdFloat B) { return _mm256_add_ps(A, B); }
+inline FClothSimdFloat SimdSub(FClothSimdFloat A, FClothSimdFloat B) { return _mm256_sub_ps(A, B); }
+inline FClothSimdFloat SimdMul(FClothSimdFloat A, FClothSimdFloat B) { return _mm256_mul_ps(A, B); }
+inline FClothSimdFloat SimdDiv(FClothSimdFloat A, FClothSimdFloat B) { return _mm256_div_ps(A, B); }
+inline FClothSimdFloat SimdMin(FClothSimdFloat A, FClothSimdFloat B) { return _mm256_min_ps(A, B); }
+inline FClothSimdFloat SimdMax(FClothSimdFloat A, FClothSimdFloat B) { return _mm256_max_ps(A, B); }
+inline FClothSimdFloat SimdSqrt(FClothSimdFloat A) { return _mm256_sqrt_ps(A); }
+inline FClothSimdFloat SimdAbs(FClothSimdFloat A) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), A); }
+inline FClothSimdFloat SimdRound(FClothSimdFloat A) { return _mm256_round_ps(A, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+inline FClothSimdFloat SimdReciprocalSqrtApprox(FClothSimdFloat A) { return _mm256_rsqrt_ps(A); }
+inline FClothSimdMask SimdCompareEqual(FClothSimdFloat A, FClothSimdFloat B) { return _mm256_cmp_ps(A, B, _CMP_EQ_OQ); }
+inline FClothSimdMask SimdCompareLess(FClothSimdFloat A, FClothSimdFloat B) { return _mm256_cmp_ps(A, B, _CMP_LT_OQ); }
+inline FClothSimdFloat SimdSelect(FClothSimdMask Mask, FClothSimdFloat IfTrue, FClothSimdFloat IfFalse) { return _mm256_blendv_ps(IfFalse, IfTrue, Mask); }
+inline bool SimdAnyTrue(FClothSimdMask Mask) { return _mm256_movemask_ps(Mask) != 0; }
+
+#elif AIRMESHCLOTH_SIMD_SSE
+
+typedef __m128 FClothSimdFloat;
+typedef __m128 FClothSimdMask;
+
+static const int ClothSimdWidth = 4;
+
+inline FClothSimdFloat SimdLoad(const float* Source) { return _mm_load_ps(Source); }
+inline FClothSimdFloat SimdLoadUnaligned(const float* Source) { return _mm_loadu_ps(Source); }
+inline void SimdStore(float* Destination, FClothSimdFloat Value) { _mm_store_ps(Destination, Value); }
+inline FClothSimdFloat SimdSet(float Value) { return _mm_set1_ps(Value); }
+inline FClothSimdFloat SimdAdd(FClothSimdFloat A, FClothSimdFloat B) { return _mm_add_ps(A, B); }
+inline FClothSimdFloat SimdSub(FClothSimdFloat A, FClothSimdFloat B) { return _mm_sub_ps(A, B); }
+inline FClothSimdFloat SimdMul(FClothSimdFloat A, FClothSimdFloat B) { return _mm_mul_ps(A, B); }
+inline FClothSimdFloat SimdDiv(FClothSimdFloat A, FClothSimdFloat B) { return _mm_div_ps(A, B); }
+inline FClothSimdFloat SimdMin(FClothSimdFloat A, FClothSimdFloat B) { return _mm_min_ps(A, B); }
+inline FClothSimdFloat SimdMax(FClothSimdFloat A, FClothSimdFloat B) { return _mm_max_ps(A, B); }
+inline FClothSimdFloat SimdSqrt(FClothSimdFloat A) { return _mm_sqrt_ps(A); }
+inline FClothSimdFloat SimdAbs(FClothSimdFloat A) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), A); }
+// Rounds to nearest even by the default rounding mode, valid within the range of int32
+inline FClothSimdFloat SimdRound(FClothSimdFloat A) { return _mm_cvtepi32_ps(_mm_cvtps_epi32(A)); }
+inline FClothSimdFloat SimdReciprocalSqrtApprox(FClothSimdFloat A) { return _mm_rsqrt_ps(A); }
+inline FClothSimdMask SimdCompareEqual(FClothSimdFloat A, FClothSimdFloat B) { return _mm_cmpeq_ps(A, B); }
+inline FClothSimdMask SimdCompareLess(FClothSimdFloat A, FClothSimdFloat B) { return _mm_cmplt_ps(A, B); }
+inline FClothSimdFloat SimdSelect(FClothSimdMask Mask, FClothSimdFloat IfTrue, FClothSimdFloat IfFalse) { return _mm_or_ps(_mm_and_ps(Mask, IfTrue), _mm_andnot_ps(Mask, IfFalse)); }
+inline bool SimdAnyTrue(FClothSimdMask Mask) { return _mm_movemask_ps(Mask) != 0; }
+
+#else
+
+typedef float FClothSimdFloat;
+typedef bool FClothSimdMask;
+
+static const int ClothSimdWidth = 1;
+
+inline FClothSimdFloat SimdLoad(const float* Source) { return *Source; }
+inline FClothSimdFloat SimdLoadUnaligned(const float* Source) { return *Source; }
+inline void SimdStore(float* Destination, FClothSimdFloat Value) { *Destination = Value; }
+inline FClothSimdFloat SimdSet(float Value) { return Value; }
+inline FClothSimdFloat SimdAdd(FClothSimdFloat A, FClothSimdFloat B) { return A + B; }
+inline FClothSimdFloat SimdSub(FClothSimdFloat A, FClothSimdFloat B) { return A - B; }
+inline FClothSimdFloat SimdMul(FClothSimdFloat A, FClothSimdFloat B) { return A * B; }
+inline FClothSimdFloat SimdDiv(FClothSimdFloat A, FClothSimdFloat B) { return A / B; }
+inline FClothSimdFloat SimdMin(FClothSimdFloat A, FClothSimdFloat B) { return A < B ? A : B; }
+inline FClothSimdFloat SimdMax(FClothSimdFloat A, FClothSimdFloat B) { return A > B ? A : B; }
+inline FClothSimdFloat SimdSqrt(FClothSimdFloat A) { return std::sqrt(A); }
+inline FClothSimdFloat SimdAbs(FClothSimdFloat A) { return std::fabs(A); }
+inline FClothSimdFloat SimdRound(FClothSimdFloat A) { return std::nearbyint(A); }
+inline FClothSimdFloat SimdReciprocalSqrtApprox(FClothSimdFloat A) { return 1.0f / std::sqrt(A); }
+inline FClothSimdMask SimdCompareEqual(FClothSimdFloat A, FClothSimdFloat B) { return A == B; }
+inline FClothSimdMask SimdCompareLess(FClothSimdFloat A, FClothSimdFloat B) { return A < B; }
+inline FClothSimdFloat SimdSelect(FClothSimdMask Mask, FClothSimdFloat IfTrue, FClothSimdFloat IfFalse) { return Mask ? IfTrue : IfFalse; }
+inline bool SimdAnyTrue(FClothSimdMask Mask) { return Mask; }
+
+#endif
+
+inline float SimdHorizontalMax(FClothSimdFloat Value)
+{
+	alignas(32) float Lanes[ClothSimdWidth];
+	SimdStore(Lanes, Value);
+
+	float Result = Lanes[0];
+	for (int Lane = 1; Lane < ClothSimdWidth; Lane++)
+	{
+		Result = Lanes[Lane] > Result ? Lanes[Lane] : Result;
+	}
+	return Result;
+}
@@ -0,0 +1,1582 @@
+// Copyright 2016 massanoori. All Rights Reserved.
+
+// Engine-independent on purpose, so the module's PCH is not included here.
+#include "AirMeshClothSolver.h"
+#include "AirMeshClothVectorMath.h"
+#include "AirMeshClothSimd.h"
+#include "AirMeshClothColoring.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <utility>
+
+// Constraints per parallel task, smaller color batches are projected inline
+static const int32_t ConstraintsPerBatch = 1024;
+
+// Culling is suspended for this many passes when the active list is outdated right after being built
+static const int32_t AirTetrahedronCullingBackoffPasses = 16;
+
+// Constraint iterations projected without Chebyshev acceleration
+static const uint32_t ChebyshevDelayIterations = 1;
+
+// Turbulence components advance at 0.9, 1 and 1.1 times the phase, so all of them repeat after this
+static const double TurbulencePhasePeriod = 20.0 * 3.14159265358979323846;
+
+static_assert(FClothPositionBuffer::PaddingGranularity % ClothSimdWidth == 0, "Position arrays must be padded to a multiple of SIMD width");
+
+namespace
+{
+	/** Edge with weight factors of its vertices, rest length is computed later */
+	FClothEdge MakeClothEdge(const FClothFloatArray& Weights, uint32_t VertexIndex0, uint32_t VertexIndex1)
+	{
+		const float Weight0 = Weights[VertexIndex0];
+		const float Weight1 = Weights[VertexIndex1];
+		const float WeightSum = Weight0 + Weight1;
+
+		FClothEdge Edge;
+		Edge.VertexIndices[0] = VertexIndex0;
+		Edge.VertexIndices[1] = VertexIndex1;
+		Edge.RestLength = 0.0f;
+
+		// Weights are 0 or 1 in grids, so factors are exact in fixed point
+		Edge.WeightFactors[0] = WeightSum > 0.0f ? (uint16_t)std::lround(Weight0 / WeightSum * FClothEdge::WeightFactorOne) : 0;
+		Edge.WeightFactors[1] = WeightSum > 0.0f ? (uint16_t)std::lround(Weight1 / WeightSum * FClothEdge::WeightFactorOne) : 0;
+		return Edge;
+	}
+}
+
+FClothTransform FClothTransform::Identity()
+{
+	FClothTransform Result =
+	{ {
+		{ 1.0f, 0.0f, 0.0f, 0.0f },
+		{ 0.0f, 1.0f, 0.0f, 0.0f },
+		{ 0.0f, 0.0f, 1.0f, 0.0f },
+	} };
+	return Result;
+}
+
+void GenerateClothGridIndices(const FClothGridDesc& Grid, std::vector<int32_t>& OutIndices)
+{
+	const uint32_t ResolutionX = Grid.ResolutionX;
+	const uint32_t ResolutionY = Grid.ResolutionY;
+
+	// build index buffer content
+	OutIndices.clear();
+	OutIndices.reserve(Grid.GetNumIndicesPerLayer() * Grid.NumLayers);
+	uint32_t NumVerticesPerLayer = Grid.GetNumVerticesPerLayer();
+	for (uint32_t Layer = 0; Layer < Grid.NumLayers; Layer++)
+	{
+		uint32_t BaseIndex = Layer * NumVerticesPerLayer;
+		for (uint32_t YIndex = 0; YIndex < ResolutionY; YIndex++)
+		{
+			for (uint32_t XIndex = 0; XIndex < ResolutionX; XIndex++)
+			{
+				int32_t I00 = BaseIndex + YIndex * (ResolutionX + 1) + XIndex;
+				int32_t I01 = BaseIndex + YIndex * (ResolutionX + 1) + XIndex + 1;
+				int32_t I10 = BaseIndex + (YIndex + 1) * (ResolutionX + 1) + XIndex;
+				int32_t I11 = BaseIndex + (YIndex + 1) * (ResolutionX + 1) + XIndex + 1;
+
+				OutIndices.push_back(I00);
+				OutIndices.push_back(I01);
+				OutIndices.push_back(I10);
+
+				OutIndices.push_back(I01);
+				OutIndices.push_back(I11);
+				OutIndices.push_back(I10);
+			}
+		}
+	}
+}
+
+void ColorClothTetrahedra(FClothTetrahedron* Tetrahedra, int32_t NumTetrahedra, std::vector<int32_t>& OutColorOffsets)
+{
+	int32_t NumVertices = 0;
+	for (int32_t TetIndex = 0; TetIndex < NumTetrahedra; TetIndex++)
+	{
+		for (int32_t VertexIndex : Tetrahedra[TetIndex].VertexIndices)
+		{
+			NumVertices = std::max(NumVertices, VertexIndex + 1);
+		}
+	}
+
+	std::vector<FClothTetrahedron> Colored(Tetrahedra, Tetrahedra + NumTetrahedra);
+	ColorConstraints<4>(Colored, NumVertices, OutColorOffsets,
+		[](const FClothTetrahedron& Tet, int32_t Index) { return Tet.VertexIndices[Index]; });
+
+	std::copy(Colored.begin(), Colored.end(), Tetrahedra);
+}
+
+FClothForceField FClothForceField::MakeDirectional(const FClothVector& Acceleration)
+{
+	FClothForceField Field = { EType::Directional, Acceleration, 0.0f, 0.0f, 0.0f };
+	return Field;
+}
+
+FClothForceField FClothForceField::MakeTurbulence(float Amplitude, float Wavelength, float Speed)
+{
+	FClothForceField Field = { EType::Turbulence, FClothVector{ 0.0f, 0.0f, 0.0f }, Amplitude, Wavelength, Speed };
+	return Field;
+}
+
+FClothForceField FClothForceField::MakeRadial(const FClothVector& Center, float Strength, float Radius)
+{
+	FClothForceField Field = { EType::Radial, Center, Strength, Radius, 0.0f };
+	return Field;
+}
+
+uint32_t FClothTimeAccumulator::Advance(float FrameDeltaTime, float FixedDeltaTime, uint32_t MaxSubsteps)
+{
+	assert(FixedDeltaTime > 0.0f);
+
+	AccumulatedTime += std::max(FrameDeltaTime, 0.0f);
+
+	uint32_t NumSubsteps = (uint32_t)(AccumulatedTime / FixedDeltaTime);
+	if (NumSubsteps > MaxSubsteps)
+	{
+		// Drop time which cannot be simulated within the budget
+		NumSubsteps = MaxSubsteps;
+		AccumulatedTime = FixedDeltaTime * NumSubsteps;
+	}
+
+	AccumulatedTime = std::max(AccumulatedTime - FixedDeltaTime * NumSubsteps, 0.0f);
+	return NumSubsteps;
+}
+
+FAirMeshClothSolver::FAirMeshClothSolver()
+	: CurrentPositionArrayIndex(0)
+	, bReorderVertices(false)
+	, NumHierarchyLevels(0)
+	, UniformAcceleration{ 0.0f, 0.0f, 0.0f }
+	, bHasVaryingForceFields(false)
+	, ForceFieldTime(0.0)
+	, EdgeAlphaTilde(0.0f)
+	, AirTetrahedronAlphaTilde(0.0f)
+	, bCullAirTetrahedra(false)
+	, bActiveAirTetrahedraValid(false)
+	, AirTetrahedronCullingMargin(0.0f)
+	, NumPassesSinceCullingUpdate(0)
+	, NumPassesToSkipCulling(0)
+	, NumActiveAirTetrahedra(0)
+	, MaxEdgeStrain(0.0f)
+	, NumInvertedAirTetrahedra(0)
+	, NumIterationsOfLastStep(0)
+	, LastIterationDisplacement(0.0f)
+{
+	EdgeColorOffsets.push_back(0);
+	AirTetrahedronColorOffsets.push_back(0);
+}
+
+void FAirMeshClothSolver::InitializeGrid(const FClothGridDesc& Grid)
+{
+	const uint32_t ResolutionX = Grid.ResolutionX;
+	const uint32_t ResolutionY = Grid.ResolutionY;
+	const uint32_t NumVertices = Grid.GetNumVerticesPerLayer() * Grid.NumLayers;
+
+	CurrentPositionArrayIndex = 0;
+	GetCurrentPositionArray().SetNum(NumVertices);
+	GetPreviousPositionArray().SetNum(NumVertices);
+
+	// Padding is treated as pinned vertices
+	SimulatedWeights.assign(FClothPositionBuffer::GetPaddedNum(NumVertices), 0.0f);
+	ClothEdges.clear();
+	ClothEdges.reserve((
+		(ResolutionX + 1) * ResolutionY +
+		ResolutionX * (ResolutionY + 1) +
+		ResolutionX * ResolutionY * 2) * Grid.NumLayers);
+	AirTetrahedra.clear();
+	AirTetrahedronColorOffsets.assign(1, 0);
+	bActiveAirTetrahedraValid = false;
+	EdgeJacobiBuffer = FJacobiBuffer();
+	AirTetrahedronJacobiBuffer = FJacobiBuffer();
+	GridToSimulatedVertex.clear();
+
+	auto AddEdge = [this](uint32_t VertexIndex0, uint32_t VertexIndex1)
+	{
+		ClothEdges.push_back(MakeClothEdge(SimulatedWeights, VertexIndex0, VertexIndex1));
+	};
+
+	for (uint32_t Layer = 0; Layer < Grid.NumLayers; Layer++)
+	{
+		uint32_t BaseVertexIndex = Layer * Grid.GetNumVerticesPerLayer();
+
+		// Generate positions
+
+		for (uint32_t YIndex = 0; YIndex < ResolutionY + 1; YIndex++)
+		{
+			for (uint32_t XIndex = 0; XIndex < ResolutionX + 1; XIndex++)
+			{
+				uint32_t VertexIndex = BaseVertexIndex + YIndex * (ResolutionX + 1) + XIndex;
+
+				FClothVector AddedPosition;
+				AddedPosition.X = XIndex * Grid.SizeX / ResolutionX - Grid.SizeX * 0.5f;
+				AddedPosition.Y = Layer * Grid.LayerInterval;
+				AddedPosition.Z = (ResolutionY - YIndex) * Grid.SizeY / ResolutionY - Grid.SizeY * 0.5f;
+				GetCurrentPositionArray().Set(VertexIndex, AddedPosition);
+
+				SimulatedWeights[VertexIndex] = YIndex == 0 ? 0.0f : 1.0f;
+			}
+		}
+
+		// Generate edge length constraints
+
+		// horizontal
+		for (uint32_t YIndex = 1 /* 0 */; YIndex < ResolutionY + 1; YIndex++)
+		{
+			for (uint32_t XIndex = 0; XIndex < ResolutionX; XIndex++)
+			{
+				uint32_t Base = YIndex * (ResolutionX + 1) + XIndex + BaseVertexIndex;
+				AddEdge(Base, Base + 1);
+			}
+		}
+
+		// vertical
+		for (uint32_t YIndex = 0; YIndex < ResolutionY; YIndex++)
+		{
+			for (uint32_t XIndex = 0; XIndex < ResolutionX + 1; XIndex++)
+			{
+				uint32_t Base = YIndex * (ResolutionX + 1) + XIndex + BaseVertexIndex;
+				AddEdge(Base, Base + (ResolutionX + 1));
+			}
+		}
+
+		// cross
+		for (uint32_t YIndex = 0; YIndex < ResolutionY; YIndex++)
+		{
+			for (uint32_t XIndex = 0; XIndex < ResolutionX; XIndex++)
+			{
+				uint32_t Base = YIndex * (ResolutionX + 1) + XIndex + BaseVertexIndex;
+
+				AddEdge(Base, Base + (ResolutionX + 1) + 1);
+				AddEdge(Base + 1, Base + (ResolutionX + 1));
+			}
+		}
+	}
+
+	// Edges sharing no vertices can be projected in parallel
+	ColorConstraints<2>(ClothEdges, (int32_t)NumVertices, EdgeColorOffsets,
+		[](const FClothEdge& Edge, int32_t Index) { return (int32_t)Edge.VertexIndices[Index]; });
+
+	// Colored in grid order, which needs fewer colors
+	if (bReorderVertices)
+	{
+		ReorderVertices(Grid);
+	}
+
+	BuildHierarchyLevels(Grid);
+}
+
+void FAirMeshClothSolver::SetReorderVertices(bool bInReorderVertices)
+{
+	bReorderVertices = bInReorderVertices;
+}
+
+void FAirMeshClothSolver::ReorderVertices(const FClothGridDesc& Grid)
+{
+	const int32_t NumVertices = GetCurrentPositionArray().Num();
+	const uint32_t NumVerticesPerLayer = Grid.GetNumVerticesPerLayer();
+
+	// Air tetrahedra connect layers, so all layers of a grid point are stored together as a tile.
+	// Tiles stay in row-major order, which edge sweeps stream through better than Morton order.
+	GridToSimulatedVertex.resize(NumVertices);
+	for (int32_t GridVertexIndex = 0; GridVertexIndex < NumVertices; GridVertexIndex++)
+	{
+		const int32_t Layer = GridVertexIndex / NumVerticesPerLayer;
+		const int32_t GridPointIndex = GridVertexIndex % NumVerticesPerLayer;
+		GridToSimulatedVertex[GridVertexIndex] = GridPointIndex * Grid.NumLayers + Layer;
+	}
+
+	// Only current positions are initialized yet
+	const FClothPositionBuffer GridPositions = GetCurrentPositionArray();
+	const FClothFloatArray GridWeights = SimulatedWeights;
+	for (int32_t GridVertexIndex = 0; GridVertexIndex < NumVertices; GridVertexIndex++)
+	{
+		GetCurrentPositionArray().Set(GridToSimulatedVertex[GridVertexIndex], GridPositions.Get(GridVertexIndex));
+		SimulatedWeights[GridToSimulatedVertex[GridVertexIndex]] = GridWeights[GridVertexIndex];
+	}
+
+	for (auto& Edge : ClothEdges)
+	{
+		Edge.VertexIndices[0] = GridToSimulatedVertex[Edge.VertexIndices[0]];
+		Edge.VertexIndices[1] = GridToSimulatedVertex[Edge.VertexIndices[1]];
+
+		if (Edge.VertexIndices[0] > Edge.VertexIndices[1])
+		{
+			std::swap(Edge.VertexIndices[0], Edge.VertexIndices[1]);
+			std::swap(Edge.WeightFactors[0], Edge.WeightFactors[1]);
+		}
+	}
+
+	// Sorting within colors keeps them conflict free
+	for (int32_t Color = 0; Color < GetNumEdgeColors(); Color++)
+	{
+		std::sort(ClothEdges.begin() + EdgeColorOffsets[Color], ClothEdges.begin() + EdgeColorOffsets[Color + 1],
+			[](const FClothEdge& A, const FClothEdge& B)
+		{
+			return A.VertexIndices[0] < B.VertexIndices[0];
+		});
+	}
+}
+
+void FAirMeshClothSolver::SetNumHierarchyLevels(int32_t InNumHierarchyLevels)
+{
+	NumHierarchyLevels = std::max(InNumHierarchyLevels, 0);
+}
+
+void FAirMeshClothSolver::BuildHierarchyLevels(const FClothGridDesc& Grid)
+{
+	HierarchyLevels.clear();
+
+	const uint32_t RowStride = Grid.ResolutionX + 1;
+	const uint32_t NumVerticesPerLayer = Grid.GetNumVerticesPerLayer();
+
+	// Grid coordinates of level vertices along an axis, the last one is kept even if not a multiple of the stride
+	auto GetLevelCoordinates = [](uint32_t Resolution, uint32_t Stride)
+	{
+		std::vector<uint32_t> Coordinates;
+		for (uint32_t Coordinate = 0; Coordinate < Resolution; Coordinate += Stride)
+		{
+			Coordinates.push_back(Coordinate);
+		}
+		Coordinates.push_back(Resolution);
+		return Coordinates;
+	};
+
+	for (int32_t LevelIndex = 1; LevelIndex <= NumHierarchyLevels; LevelIndex++)
+	{
+		const uint32_t Stride = 1u << LevelIndex;
+		if (Stride >= std::max(Grid.ResolutionX, Grid.ResolutionY))
+		{
+			break;
+		}
+
+		const std::vector<uint32_t> Xs = GetLevelCoordinates(Grid.ResolutionX, Stride);
+		const std::vector<uint32_t> Ys = GetLevelCoordinates(Grid.ResolutionY, Stride);
+		const int32_t NumLevelVerticesPerLayer = (int32_t)(Xs.size() * Ys.size());
+
+		HierarchyLevels.emplace_back();
+		auto& Level = HierarchyLevels.back();
+
+		for (uint32_t Layer = 0; Layer < Grid.NumLayers; Layer++)
+		{
+			const int32_t LevelBase = Layer * NumLevelVerticesPerLayer;
+			auto GetVertexIndex = [&](uint32_t XIndex, uint32_t YIndex)
+			{
+				return (uint32_t)GetSimulatedVertexIndex(Layer * NumVerticesPerLayer + YIndex * RowStride + XIndex);
+			};
+			auto GetLevelVertex = [&](size_t XCell, size_t YCell)
+			{
+				return LevelBase + (int32_t)(YCell * Xs.size() + XCell);
+			};
+			auto AddEdge = [&](size_t XCell0, size_t YCell0, size_t XCell1, size_t YCell1)
+			{
+				Level.Edges.push_back(MakeClothEdge(SimulatedWeights, GetVertexIndex(Xs[XCell0], Ys[YCell0]), GetVertexIndex(Xs[XCell1], Ys[YCell1])));
+			};
+
+			for (uint32_t Y : Ys)
+			{
+				for (uint32_t X : Xs)
+				{
+					Level.Vertices.push_back(GetVertexIndex(X, Y));
+				}
+			}
+
+			// Same topology as fine edges, the top row is pinned
+			for (size_t YCell = 1; YCell < Ys.size(); YCell++)
+			{
+				for (size_t XCell = 0; XCell + 1 < Xs.size(); XCell++)
+				{
+					AddEdge(XCell, YCell, XCell + 1, YCell);
+				}
+			}
+
+			for (size_t YCell = 0; YCell + 1 < Ys.size(); YCell++)
+			{
+				for (size_t XCell = 0; XCell < Xs.size(); XCell++)
+				{
+					AddEdge(XCell, YCell, XCell, YCell + 1);
+				}
+
+				for (size_t XCell = 0; XCell + 1 < Xs.size(); XCell++)
+				{
+					AddEdge(XCell, YCell, XCell + 1, YCell + 1);
+					AddEdge(XCell + 1, YCell, XCell, YCell + 1);
+				}
+			}
+
+			// Every other vertex between level vertices follows their corrections
+			for (size_t YCell = 0; YCell + 1 < Ys.size(); YCell++)
+			{
+				for (uint32_t Y = Ys[YCell]; Y <= Ys[YCell + 1]; Y++)
+				{
+					for (size_t XCell = 0; XCell + 1 < Xs.size(); XCell++)
+					{
+						for (uint32_t X = Xs[XCell]; X <= Xs[XCell + 1]; X++)
+						{
+							const bool bOnLevelX = X == Xs[XCell] || X == Xs[XCell + 1];
+							const bool bOnLevelY = Y == Ys[YCell] || Y == Ys[YCell + 1];
+							const bool bOwnedByCell = (X < Xs[XCell + 1] || XCell + 2 == Xs.size()) && (Y < Ys[YCell + 1] || YCell + 2 == Ys.size());
+							const uint32_t VertexIndex = GetVertexIndex(X, Y);
+
+							if ((bOnLevelX && bOnLevelY) || !bOwnedByCell || SimulatedWeights[VertexIndex] == 0.0f)
+							{
+								continue;
+							}
+
+							const float TX = (float)(X - Xs[XCell]) / (Xs[XCell + 1] - Xs[XCell]);
+							const float TY = (float)(Y - Ys[YCell]) / (Ys[YCell + 1] - Ys[YCell]);
+
+							FHierarchyLevel::FProlongation Prolongation;
+							Prolongation.VertexIndex = VertexIndex;
+							Prolongation.Corners[0] = GetLevelVertex(XCell, YCell);
+							Prolongation.Corners[1] = GetLevelVertex(XCell + 1, YCell);
+							Prolongation.Corners[2] = GetLevelVertex(XCell, YCell + 1);
+							Prolongation.Corners[3] = GetLevelVertex(XCell + 1, YCell + 1);
+							Prolongation.Weights[0] = (1.0f - TX) * (1.0f - TY);
+							Prolongation.Weights[1] = TX * (1.0f - TY);
+							Prolongation.Weights[2] = (1.0f - TX) * TY;
+							Prolongation.Weights[3] = TX * TY;
+							Level.Prolongations.push_back(Prolongation);
+						}
+					}
+				}
+			}
+		}
+
+		ColorConstraints<2>(Level.Edges, GetCurrentPositionArray().Num(), Level.EdgeColorOffsets,
+			[](const FClothEdge& Edge, int32_t Index) { return (int32_t)Edge.VertexIndices[Index]; });
+		Level.Corrections.resize(Level.Vertices.size());
+	}
+}
+
+void FAirMeshClothSolver::TransformPositions(const FClothTransform& Transform)
+{
+	auto& Positions = GetCurrentPositionArray();
+
+	for (int32_t VertexIndex = 0; VertexIndex < Positions.Num(); VertexIndex++)
+	{
+		Positions.Set(VertexIndex, Transform.TransformPosition(Positions.Get(VertexIndex)));
+	}
+}
+
+void FAirMeshClothSolver::FinalizeRestState()
+{
+	const auto& Positions = GetCurrentPositionArray();
+
+	// Compute rest lengths
+	auto ComputeRestLengths = [&Positions](std::vector<FClothEdge>& Edges)
+	{
+		for (auto& Edge : Edges)
+		{
+			auto Diff = Positions.Get(Edge.VertexIndices[0]) - Positions.Get(Edge.VertexIndices[1]);
+			Edge.RestLength = Size(Diff);
+		}
+	};
+
+	ComputeRestLengths(ClothEdges);
+	for (auto& Level : HierarchyLevels)
+	{
+		ComputeRestLengths(Level.Edges);
+	}
+
+	// Initialize previous positions with current positions
+	GetPreviousPositionArray() = Positions;
+
+	bActiveAirTetrahedraValid = false;
+}
+
+void FAirMeshClothSolver::SetAirTetrahedra(const FClothTetrahedron* Tetrahedra, int32_t NumTetrahedra, const int32_t* ColorOffsets, int32_t NumColors)
+{
+	assert(Tetrahedra != nullptr || NumTetrahedra == 0);
+	assert(ColorOffsets != nullptr && ColorOffsets[0] == 0 && ColorOffsets[NumColors] == NumTetrahedra);
+
+	AirTetrahedra.assign(Tetrahedra, Tetrahedra + NumTetrahedra);
+	AirTetrahedronColorOffsets.assign(ColorOffsets, ColorOffsets + NumColors + 1);
+
+	if (!GridToSimulatedVertex.empty())
+	{
+		for (auto& Tet : AirTetrahedra)
+		{
+			for (int32_t Vertex = 0; Vertex < 4; Vertex++)
+			{
+				Tet.VertexIndices[Vertex] = GridToSimulatedVertex[Tet.VertexIndices[Vertex]];
+			}
+		}
+
+		// Sorting within colors keeps them conflict free
+		for (int32_t Color = 0; Color < NumColors; Color++)
+		{
+			std::stable_sort(AirTetrahedra.begin() + ColorOffsets[Color], AirTetrahedra.begin() + ColorOffsets[Color + 1],
+				[](const FClothTetrahedron& A, const FClothTetrahedron& B)
+			{
+				return *std::min_element(A.VertexIndices, A.VertexIndices + 4) < *std::min_element(B.VertexIndices, B.VertexIndices + 4);
+			});
+		}
+	}
+
+	bActiveAirTetrahedraValid = false;
+	AirTetrahedronJacobiBuffer = FJacobiBuffer();
+}
+
+void FAirMeshClothSolver::SetCullAirTetrahedra(bool bInCullAirTetrahedra)
+{
+	bCullAirTetrahedra = bInCullAirTetrahedra;
+	bActiveAirTetrahedraValid = false;
+	NumPassesToSkipCulling = 0;
+}
+
+void FAirMeshClothSolver::SetParallelFor(const FClothParallelFor& InParallelFor)
+{
+	ParallelFor = InParallelFor;
+}
+
+void FAirMeshClothSolver::SetForceFields(const FClothForceField* Fields, int32_t NumFields)
+{
+	ForceFields.assign(Fields, Fields + NumFields);
+	UpdateActiveForceFields();
+}
+
+void FAirMeshClothSolver::SetFirstSubstepForceFields(const FClothForceField* Fields, int32_t NumFields)
+{
+	FirstSubstepForceFields.assign(Fields, Fields + NumFields);
+	UpdateActiveForceFields();
+}
+
+void FAirMeshClothSolver::UpdateActiveForceFields()
+{
+	ActiveForceFields = ForceFields;
+	ActiveForceFields.insert(ActiveForceFields.end(), FirstSubstepForceFields.begin(), FirstSubstepForceFields.end());
+	UniformAcceleration = FClothVector{ 0.0f, 0.0f, 0.0f };
+	bHasVaryingForceFields = false;
+
+	for (const FClothForceField& Field : ActiveForceFields)
+	{
+		if (Field.Type == FClothForceField::EType::Directional)
+		{
+			UniformAcceleration += Field.Vector;
+		}
+		else
+		{
+			bHasVaryingForceFields = true;
+		}
+	}
+}
+
+void FAirMeshClothSolver::ForEachBatch(int32_t Begin, int32_t End, const std::function<void(int32_t, int32_t)>& RangeBody) const
+{
+	const int32_t NumBatches = (End - Begin + ConstraintsPerBatch - 1) / ConstraintsPerBatch;
+
+	if (NumBatches <= 1 || !ParallelFor)
+	{
+		RangeBody(Begin, End);
+		return;
+	}
+
+	ParallelFor(NumBatches, [Begin, End, &RangeBody](int32_t BatchIndex)
+	{
+		const int32_t BatchBegin = Begin + BatchIndex * ConstraintsPerBatch;
+		RangeBody(BatchBegin, std::min(BatchBegin + ConstraintsPerBatch, End));
+	});
+}
+
+void FAirMeshClothSolver::CopyPositions(FClothVector* OutPositions) const
+{
+	const auto& Positions = GetCurrentPositionArray();
+
+	for (int32_t VertexIndex = 0; VertexIndex < Positions.Num(); VertexIndex++)
+	{
+		OutPositions[VertexIndex] = Positions.Get(GetSimulatedVertexIndex(VertexIndex));
+	}
+}
+
+void FAirMeshClothSolver::CopyPositions(FClothVector* OutPositions, const FClothTransform& Transform) const
+{
+	const auto& Positions = GetCurrentPositionArray();
+
+	for (int32_t VertexIndex = 0; VertexIndex < Positions.Num(); VertexIndex++)
+	{
+		OutPositions[VertexIndex] = Transform.TransformPosition(Positions.Get(GetSimulatedVertexIndex(VertexIndex)));
+	}
+}
+
+void FAirMeshClothSolver::CopyInterpolatedPositions(FClothVector* OutPositions, const FClothTransform& Transform, float Alpha) const
+{
+	if (Alpha >= 1.0f)
+	{
+		CopyPositions(OutPositions, Transform);
+		return;
+	}
+
+	const auto& Positions = GetCurrentPositionArray();
+	const auto& PreviousPositions = GetPreviousPositionArray();
+
+	for (int32_t VertexIndex = 0; VertexIndex < Positions.Num(); VertexIndex++)
+	{
+		const int32_t SimulatedVertexIndex = GetSimulatedVertexIndex(VertexIndex);
+		const auto Current = Positions.Get(SimulatedVertexIndex);
+		if (SimulatedWeights[SimulatedVertexIndex] == 0.0f)
+		{
+			// Interpolation would leave it behind its attachment by the motion of the transform
+			OutPositions[VertexIndex] = Transform.TransformPosition(Current);
+			continue;
+		}
+
+		const auto Previous = PreviousPositions.Get(SimulatedVertexIndex);
+		OutPositions[VertexIndex] = Transform.TransformPosition(Previous + (Current - Previous) * Alpha);
+	}
+}
+
+void FAirMeshClothSolver::CalcBounds(FClothVector& OutMin, FClothVector& OutMax) const
+{
+	const auto& Positions = GetCurrentPositionArray();
+
+	OutMin = FClothVector{ FLT_MAX, FLT_MAX, FLT_MAX };
+	OutMax = FClothVector{ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+	for (int32_t VertexIndex = 0; VertexIndex < Positions.Num(); VertexIndex++)
+	{
+		OutMin.X = std::min(OutMin.X, Positions.X[VertexIndex]);
+		OutMin.Y = std::min(OutMin.Y, Positions.Y[VertexIndex]);
+		OutMin.Z = std::min(OutMin.Z, Positions.Z[VertexIndex]);
+		OutMax.X = std::max(OutMax.X, Positions.X[VertexIndex]);
+		OutMax.Y = std::max(OutMax.Y, Positions.Y[VertexIndex]);
+		OutMax.Z = std::max(OutMax.Z, Positions.Z[VertexIndex]);
+	}
+}
+
+void FAirMeshClothSolver::Step(const FClothStepParams& Params)
+{
+	FClothStepParams SubstepParams = Params;
+	NumIterationsOfLastStep = 0;
+
+	for (uint32_t Substep = 0; Substep < Params.NumSubsteps; Substep++)
+	{
+		// Pinned vertices have already reached the transform
+		if (Substep == 1)
+		{
+			SubstepParams.PinnedVertexTransform = FClothTransform::Identity();
+		}
+
+		if (bHasVaryingForceFields)
+		{
+			EvaluateForceFields(Params.DeltaTime);
+		}
+
+		Integrate(SubstepParams);
+
+		if (!FirstSubstepForceFields.empty())
+		{
+			FirstSubstepForceFields.clear();
+			UpdateActiveForceFields();
+		}
+
+		// Multipliers start from 0 every substep
+		const float InverseDeltaTimeSquared = Params.DeltaTime > 0.0f ? 1.0f / (Params.DeltaTime * Params.DeltaTime) : 0.0f;
+		EdgeAlphaTilde = Params.EdgeCompliance * InverseDeltaTimeSquared;
+		AirTetrahedronAlphaTilde = Params.AirMeshCompliance * InverseDeltaTimeSquared;
+
+		if (EdgeAlphaTilde > 0.0f)
+		{
+			EdgeLambdas.assign(ClothEdges.size(), 0.0f);
+		}
+
+		if (AirTetrahedronAlphaTilde > 0.0f)
+		{
+			AirTetrahedronLambdas.assign(AirTetrahedra.size(), 0.0f);
+		}
+
+		// Enforce constraints
+
+		ProjectHierarchyLevels(Params.NumCoarseIterations);
+
+		const float SpectralRadiusSquared = Params.ChebyshevSpectralRadius * Params.ChebyshevSpectralRadius;
+		const bool bAccelerate = Params.ChebyshevSpectralRadius > 0.0f;
+		float Omega = 1.0f;
+
+		if (bAccelerate)
+		{
+			IterationPositions[0] = GetCurrentPositionArray();
+			IterationPositions[1] = GetCurrentPositionArray();
+		}
+		LastIterationDisplacement = 0.0f;
+
+		for (uint32_t Iteration = 0; Iteration < Params.NumIterations; Iteration++)
+		{
+			if (Params.bUseJacobi)
+			{
+				ProjectEdgeConstraintsJacobi();
+
+				if (Params.bUseAirMesh)
+				{
+					ProjectAirTetrahedraJacobi();
+				}
+			}
+			else
+			{
+				ProjectEdgeConstraints();
+
+				if (Params.bUseAirMesh)
+				{
+					ProjectAirTetrahedra();
+				}
+			}
+
+			if (bAccelerate)
+			{
+				// Chebyshev weights start after the first iteration, which is far from the asymptotic rate
+				if (Iteration == ChebyshevDelayIterations)
+				{
+					Omega = 2.0f / (2.0f - SpectralRadiusSquared);
+				}
+				else if (Iteration > ChebyshevDelayIterations)
+				{
+					Omega = 4.0f / (4.0f - SpectralRadiusSquared * Omega);
+				}
+
+				AccelerateIteration(Omega);
+			}
+
+			NumIterationsOfLastStep++;
+
+			// Further iterations would hardly move vertices
+			const bool bConverged =
+				MaxEdgeStrain <= Params.StrainTolerance &&
+				(!Params.bUseAirMesh || NumInvertedAirTetrahedra == 0);
+
+			if (Params.StrainTolerance > 0.0f && Iteration + 1 >= Params.MinIterations && bConverged)
+			{
+				break;
+			}
+		}
+	}
+}
+
+void FAirMeshClothSolver::AccelerateIteration(float Omega)
+{
+	auto& Positions = GetCurrentPositionArray();
+
+	// IterationPositions[0] is the previous iterate after swapping, and is overwritten by the next one
+	std::swap(IterationPositions[0], IterationPositions[1]);
+
+	float* X = Positions.X.data();
+	float* Y = Positions.Y.data();
+	float* Z = Positions.Z.data();
+	float* PreviousX = IterationPositions[0].X.data();
+	float* PreviousY = IterationPositions[0].Y.data();
+	float* PreviousZ = IterationPositions[0].Z.data();
+	const float* LatestX = IterationPositions[1].X.data();
+	const float* LatestY = IterationPositions[1].Y.data();
+	const float* LatestZ = IterationPositions[1].Z.data();
+
+	const FClothSimdFloat SimdOmega = SimdSet(Omega);
+	FClothSimdFloat MaxDisplacementSquared = SimdSet(0.0f);
+
+	// Pinned vertices and padding are not moved by projections, so they stay in place
+	for (int32_t VertexIndex = 0; VertexIndex < Positions.PaddedNum(); VertexIndex += ClothSimdWidth)
+	{
+		FClothSimdFloat ProjectedX = SimdLoad(X + VertexIndex);
+		FClothSimdFloat ProjectedY = SimdLoad(Y + VertexIndex);
+		FClothSimdFloat ProjectedZ = SimdLoad(Z + VertexIndex);
+
+		FClothSimdFloat DX = SimdSub(ProjectedX, SimdLoad(LatestX + VertexIndex));
+		FClothSimdFloat DY = SimdSub(ProjectedY, SimdLoad(LatestY + VertexIndex));
+		FClothSimdFloat DZ = SimdSub(ProjectedZ, SimdLoad(LatestZ + VertexIndex));
+		MaxDisplacementSquared = SimdMax(MaxDisplacementSquared, SimdAdd(SimdAdd(SimdMul(DX, DX), SimdMul(DY, DY)), SimdMul(DZ, DZ)));
+
+		FClothSimdFloat OldX = SimdLoad(PreviousX + VertexIndex);
+		FClothSimdFloat OldY = SimdLoad(PreviousY + VertexIndex);
+		FClothSimdFloat OldZ = SimdLoad(PreviousZ + VertexIndex);
+		FClothSimdFloat NextX = SimdAdd(OldX, SimdMul(SimdOmega, SimdSub(ProjectedX, OldX)));
+		FClothSimdFloat NextY = SimdAdd(OldY, SimdMul(SimdOmega, SimdSub(ProjectedY, OldY)));
+		FClothSimdFloat NextZ = SimdAdd(OldZ, SimdMul(SimdOmega, SimdSub(ProjectedZ, OldZ)));
+
+		SimdStore(X + VertexIndex, NextX);
+		SimdStore(Y + VertexIndex, NextY);
+		SimdStore(Z + VertexIndex, NextZ);
+		SimdStore(PreviousX + VertexIndex, NextX);
+		SimdStore(PreviousY + VertexIndex, NextY);
+		SimdStore(PreviousZ + VertexIndex, NextZ);
+	}
+
+	LastIterationDisplacement = std::sqrt(SimdHorizontalMax(MaxDisplacementSquared));
+}
+
+namespace
+{
+	/** Parabolic approximation of sine with an error of about 0.001, smooth enough for turbulence */
+	inline FClothSimdFloat SimdSinApprox(FClothSimdFloat Angle)
+	{
+		// Wrap to [-0.5, 0.5] turns
+		FClothSimdFloat T = SimdMul(Angle, SimdSet(0.15915494f));
+		T = SimdSub(T, SimdRound(T));
+
+		const FClothSimdFloat Y = SimdMul(SimdSub(SimdSet(8.0f), SimdMul(SimdSet(16.0f), SimdAbs(T))), T);
+		return SimdAdd(Y, SimdMul(SimdSet(0.225f), SimdSub(SimdMul(Y, SimdAbs(Y)), Y)));
+	}
+}
+
+void FAirMeshClothSolver::EvaluateForceFields(float DeltaTime)
+{
+	FClothPositionBuffer& Positions = GetCurrentPositionArray();
+	if (ExternalAccelerations.Num() != Positions.Num())
+	{
+		ExternalAccelerations.SetNum(Positions.Num());
+	}
+
+	const float* X = Positions.X.data();
+	const float* Y = Positions.Y.data();
+	const float* Z = Positions.Z.data();
+	float* AccelerationX = ExternalAccelerations.X.data();
+	float* AccelerationY = ExternalAccelerations.Y.data();
+	float* AccelerationZ = ExternalAccelerations.Z.data();
+	const FClothForceField* Fields = ActiveForceFields.data();
+	const int32_t NumFields = (int32_t)ActiveForceFields.size();
+
+	// Phases are wrapped in double precision, since the time grows without bound and would make them jitter as floats
+	ForceFieldPhases.resize(ActiveForceFields.size());
+	for (size_t FieldIndex = 0; FieldIndex < ActiveForceFields.size(); FieldIndex++)
+	{
+		ForceFieldPhases[FieldIndex] = (float)std::fmod(ActiveForceFields[FieldIndex].Speed * ForceFieldTime, TurbulencePhasePeriod);
+	}
+	const float* Phases = ForceFieldPhases.data();
+
+	// All fields are accumulated per register, so accelerations are written once.
+	// Batches start at multiples of ConstraintsPerBatch, which keeps registers aligned.
+	ForEachBatch(0, Positions.PaddedNum(), [=](int32_t Begin, int32_t End)
+	{
+		for (int32_t VertexIndex = Begin; VertexIndex < End; VertexIndex += ClothSimdWidth)
+		{
+			const FClothSimdFloat PX = SimdLoad(X + VertexIndex);
+			const FClothSimdFloat PY = SimdLoad(Y + VertexIndex);
+			const FClothSimdFloat PZ = SimdLoad(Z + VertexIndex);
+			FClothSimdFloat AX = SimdSet(0.0f);
+			FClothSimdFloat AY = SimdSet(0.0f);
+			FClothSimdFloat AZ = SimdSet(0.0f);
+
+			for (int32_t FieldIndex = 0; FieldIndex < NumFields; FieldIndex++)
+			{
+				const FClothForceField& Field = Fields[FieldIndex];
+
+				if (Field.Type == FClothForceField::EType::Turbulence)
+				{
+					// Each component is a wave travelling along another diagonal at another rate, so the pattern does not visibly repeat
+					const FClothSimdFloat WaveNumber = SimdSet(Field.Radius > 0.0f ? 6.2831853f / Field.Radius : 0.0f);
+					const FClothSimdFloat Amplitude = SimdSet(Field.Strength);
+					const float Phase = Phases[FieldIndex];
+					const FClothSimdFloat AngleX = SimdAdd(SimdMul(WaveNumber, SimdAdd(PY, SimdMul(PZ, SimdSet(1.3f)))), SimdSet(Phase));
+					const FClothSimdFloat AngleY = SimdAdd(SimdMul(WaveNumber, SimdAdd(PZ, SimdMul(PX, SimdSet(1.7f)))), SimdSet(Phase * 1.1f + 2.0f));
+					const FClothSimdFloat AngleZ = SimdAdd(SimdMul(WaveNumber, SimdAdd(PX, SimdMul(PY, SimdSet(1.9f)))), SimdSet(Phase * 0.9f + 4.0f));
+					AX = SimdAdd(AX, SimdMul(Amplitude, SimdSinApprox(AngleX)));
+					AY = SimdAdd(AY, SimdMul(Amplitude, SimdSinApprox(AngleY)));
+					AZ = SimdAdd(AZ, SimdMul(Amplitude, SimdSinApprox(AngleZ)));
+				}
+				else if (Field.Type == FClothForceField::EType::Radial && Field.Radius > 0.0f)
+				{
+					const FClothSimdFloat DX = SimdSub(PX, SimdSet(Field.Vector.X));
+					const FClothSimdFloat DY = SimdSub(PY, SimdSet(Field.Vector.Y));
+					const FClothSimdFloat DZ = SimdSub(PZ, SimdSet(Field.Vector.Z));
+
+					// Offset avoids division by zero at the center, where the direction is undefined anyway
+					const FClothSimdFloat Distance = SimdSqrt(SimdAdd(SimdAdd(SimdAdd(SimdMul(DX, DX), SimdMul(DY, DY)), SimdMul(DZ, DZ)), SimdSet(1.0e-6f)));
+					const FClothSimdFloat Falloff = SimdMax(SimdSub(SimdSet(1.0f), SimdMul(Distance, SimdSet(1.0f / Field.Radius))), SimdSet(0.0f));
+					const FClothSimdFloat Scale = SimdDiv(SimdMul(SimdSet(Field.Strength), Falloff), Distance);
+					AX = SimdAdd(AX, SimdMul(DX, Scale));
+					AY = SimdAdd(AY, SimdMul(DY, Scale));
+					AZ = SimdAdd(AZ, SimdMul(DZ, Scale));
+				}
+			}
+
+			SimdStore(AccelerationX + VertexIndex, AX);
+			SimdStore(AccelerationY + VertexIndex, AY);
+			SimdStore(AccelerationZ + VertexIndex, AZ);
+		}
+	});
+
+	ForceFieldTime += DeltaTime;
+}
+
+void FAirMeshClothSolver::Integrate(const FClothStepParams& Params)
+{
+	const auto& Transform = Params.PinnedVertexTransform;
+
+	const FClothSimdFloat Zero = SimdSet(0.0f);
+	const FClothSimdFloat Inertia = SimdSet(1.0f - Params.Damping);
+	const float DeltaTimeSquared = Params.DeltaTime * Params.DeltaTime;
+	const FClothSimdFloat SimdDeltaTimeSquared = SimdSet(DeltaTimeSquared);
+	const FClothSimdFloat UniformX = SimdSet(DeltaTimeSquared * UniformAcceleration.X);
+	const FClothSimdFloat UniformY = SimdSet(DeltaTimeSquared * UniformAcceleration.Y);
+	const FClothSimdFloat UniformZ = SimdSet(DeltaTimeSquared * (Params.GravityZ + UniformAcceleration.Z));
+
+	FClothSimdFloat M[3][4];
+	for (int32_t Row = 0; Row < 3; Row++)
+	{
+		for (int32_t Column = 0; Column < 4; Column++)
+		{
+			M[Row][Column] = SimdSet(Transform.M[Row][Column]);
+		}
+	}
+
+	const auto& CurrentPositions = GetCurrentPositionArray();
+	auto& PreviousPositions = GetPreviousPositionArray();
+
+	// Raw pointers, otherwise SIMD stores may alias with the arrays and force reloading them every iteration
+	const float* CurrentX = CurrentPositions.X.data();
+	const float* CurrentY = CurrentPositions.Y.data();
+	const float* CurrentZ = CurrentPositions.Z.data();
+	float* PreviousX = PreviousPositions.X.data();
+	float* PreviousY = PreviousPositions.Y.data();
+	float* PreviousZ = PreviousPositions.Z.data();
+	const float* Weights = SimulatedWeights.data();
+
+	// Evaluated by EvaluateForceFields()
+	const bool bHasVaryingAccelerations = bHasVaryingForceFields && ExternalAccelerations.Num() == CurrentPositions.Num();
+	const float* AccelerationX = ExternalAccelerations.X.data();
+	const float* AccelerationY = ExternalAccelerations.Y.data();
+	const float* AccelerationZ = ExternalAccelerations.Z.data();
+
+	// Previous positions are overwritten by next positions, then arrays are swapped.
+	// Padding has zero weight, so whole SIMD registers are always processed.
+	const int32_t PaddedNum = CurrentPositions.PaddedNum();
+	for (int32_t VertexIndex = 0; VertexIndex < PaddedNum; VertexIndex += ClothSimdWidth)
+	{
+		FClothSimdFloat X = SimdLoad(CurrentX + VertexIndex);
+		FClothSimdFloat Y = SimdLoad(CurrentY + VertexIndex);
+		FClothSimdFloat Z = SimdLoad(CurrentZ + VertexIndex);
+
+		// Other vertices are integrated by Verlet
+		FClothSimdFloat NextX = SimdAdd(SimdAdd(X, SimdMul(SimdSub(X, SimdLoad(PreviousX + VertexIndex)), Inertia)), UniformX);
+		FClothSimdFloat NextY = SimdAdd(SimdAdd(Y, SimdMul(SimdSub(Y, SimdLoad(PreviousY + VertexIndex)), Inertia)), UniformY);
+		FClothSimdFloat NextZ = SimdAdd(SimdAdd(Z, SimdMul(SimdSub(Z, SimdLoad(PreviousZ + VertexIndex)), Inertia)), UniformZ);
+
+		if (bHasVaryingAccelerations)
+		{
+			NextX = SimdAdd(NextX, SimdMul(SimdLoad(AccelerationX + VertexIndex), SimdDeltaTimeSquared));
+			NextY = SimdAdd(NextY, SimdMul(SimdLoad(AccelerationY + VertexIndex), SimdDeltaTimeSquared));
+			NextZ = SimdAdd(NextZ, SimdMul(SimdLoad(AccelerationZ + VertexIndex), SimdDeltaTimeSquared));
+		}
+
+		// Pinned vertices follow the component.
+		// They are rare, so the transform is skipped for registers without them.
+		FClothSimdMask Pinned = SimdCompareEqual(SimdLoad(Weights + VertexIndex), Zero);
+		if (SimdAnyTrue(Pinned))
+		{
+			FClothSimdFloat PinnedX = SimdAdd(SimdAdd(SimdAdd(SimdMul(M[0][0], X), SimdMul(M[0][1], Y)), SimdMul(M[0][2], Z)), M[0][3]);
+			FClothSimdFloat PinnedY = SimdAdd(SimdAdd(SimdAdd(SimdMul(M[1][0], X), SimdMul(M[1][1], Y)), SimdMul(M[1][2], Z)), M[1][3]);
+			FClothSimdFloat PinnedZ = SimdAdd(SimdAdd(SimdAdd(SimdMul(M[2][0], X), SimdMul(M[2][1], Y)), SimdMul(M[2][2], Z)), M[2][3]);
+
+			NextX = SimdSelect(Pinned, PinnedX, NextX);
+			NextY = SimdSelect(Pinned, PinnedY, NextY);
+			NextZ = SimdSelect(Pinned, PinnedZ, NextZ);
+		}
+
+		SimdStore(PreviousX + VertexIndex, NextX);
+		SimdStore(PreviousY + VertexIndex, NextY);
+		SimdStore(PreviousZ + VertexIndex, NextZ);
+	}
+
+	// Swap array
+	CurrentPositionArrayIndex ^= 1;
+}
+
+namespace
+{
+	/** Corrections to be added to the edge vertices, returns the strain (CurrentLength - RestLength) / CurrentLength */
+	inline float CalcEdgeCorrections(const FClothEdge& Edge, const FClothVector& V0, const FClothVector& V1, FClothVector& OutCorrection0, FClothVector& OutCorrection1)
+	{
+		auto Diff = V1 - V0;
+		float CurrentLength = Size(Diff);
+		float Scale = (CurrentLength - Edge.RestLength) / CurrentLength;
+		OutCorrection0 = Diff * (Scale * Edge.GetWeightFactor(0));
+		OutCorrection1 = -(Diff * (Scale * Edge.GetWeightFactor(1)));
+		return Scale;
+	}
+
+	/** Reduces results of parallel batches */
+	inline void AtomicMax(std::atomic<float>& Target, float Value)
+	{
+		float Current = Target.load(std::memory_order_relaxed);
+		while (Value > Current && !Target.compare_exchange_weak(Current, Value, std::memory_order_relaxed))
+		{
+		}
+	}
+
+	/**
+	 * Corrections to be added to the tetrahedron vertices, returns false if the tetrahedron is not inverted.
+	 * With InOutLambda, corrections follow XPBD. The multiplier only pushes the volume positive.
+	 */
+	inline bool CalcAirTetrahedronCorrections(const FClothVector* P, const float* Weights, FClothVector* OutCorrections,
+		float AlphaTilde = 0.0f, float* InOutLambda = nullptr)
+	{
+		// Check negative volume
+		auto Grad0 = CrossProduct(P[1] - P[3], P[2] - P[3]);
+		float Volume = DotProduct(P[0] - P[3], Grad0);
+
+		if (Volume >= 0.0f)
+		{
+			return false;
+		}
+
+		// Negating 2nd and 4th gradients
+		// based on an extraction formula of determinant
+
+		auto Grad1 = -CrossProduct(P[2] - P[0], P[3] - P[0]);
+		auto Grad2 = CrossProduct(P[3] - P[1], P[0] - P[1]);
+		auto Grad3 = -CrossProduct(P[0] - P[2], P[1] - P[2]);
+
+		float Grad0SizeSq = SizeSquared(Grad0);
+
+		float Denominator =
+			Weights[0] * Grad0SizeSq +
+			Weights[1] * SizeSquared(Grad1) +
+			Weights[2] * SizeSquared(Grad2) +
+			Weights[3] * SizeSquared(Grad3);
+
+		if (std::fabs(Denominator) <= Grad0SizeSq * 1e-7f)
+		{
+			return false;
+		}
+
+		float ScalingFactor = Volume / Denominator;
+		if (InOutLambda)
+		{
+			const float DeltaLambda = std::max((-Volume - AlphaTilde * *InOutLambda) / (Denominator + AlphaTilde), -*InOutLambda);
+			*InOutLambda += DeltaLambda;
+			ScalingFactor = -DeltaLambda;
+		}
+
+		OutCorrections[0] = -(Weights[0] * ScalingFactor * Grad0);
+		OutCorrections[1] = -(Weights[1] * ScalingFactor * Grad1);
+		OutCorrections[2] = -(Weights[2] * ScalingFactor * Grad2);
+		OutCorrections[3] = -(Weights[3] * ScalingFactor * Grad3);
+		return true;
+	}
+
+	/** Builds vertex to slot mapping of FJacobiBuffer, slots of a vertex are in the order of constraints */
+	template <int32_t NumConstraintVertices, typename DeltaType, typename ConstraintType>
+	void BuildJacobiSlots(const std::vector<ConstraintType>& Constraints, int32_t NumVertices,
+		std::vector<DeltaType>& OutDeltas, std::vector<int32_t>& OutVertexSlotOffsets, std::vector<int32_t>& OutVertexSlots)
+	{
+		const int32_t NumSlots = (int32_t)Constraints.size() * NumConstraintVertices;
+
+		OutDeltas.resize(NumSlots);
+		OutVertexSlotOffsets.assign(NumVertices + 1, 0);
+		OutVertexSlots.resize(NumSlots);
+
+		for (const auto& Constraint : Constraints)
+		{
+			for (int32_t Vertex = 0; Vertex < NumConstraintVertices; Vertex++)
+			{
+				OutVertexSlotOffsets[Constraint.VertexIndices[Vertex] + 1]++;
+			}
+		}
+
+		for (int32_t VertexIndex = 0; VertexIndex < NumVertices; VertexIndex++)
+		{
+			OutVertexSlotOffsets[VertexIndex + 1] += OutVertexSlotOffsets[VertexIndex];
+		}
+
+		std::vector<int32_t> NextSlots(OutVertexSlotOffsets.begin(), OutVertexSlotOffsets.end() - 1);
+		for (int32_t Slot = 0; Slot < NumSlots; Slot++)
+		{
+			int32_t VertexIndex = Constraints[Slot / NumConstraintVertices].VertexIndices[Slot % NumConstraintVertices];
+			OutVertexSlots[NextSlots[VertexIndex]++] = Slot;
+		}
+	}
+}
+
+void FAirMeshClothSolver::ProjectEdgeConstraints()
+{
+	std::atomic<float> MaxStrain(0.0f);
+
+	for (int32_t Color = 0; Color < GetNumEdgeColors(); Color++)
+	{
+		ForEachBatch(EdgeColorOffsets[Color], EdgeColorOffsets[Color + 1], [this, &MaxStrain](int32_t Begin, int32_t End)
+		{
+			AtomicMax(MaxStrain, ProjectEdgeConstraints(Begin, End));
+		});
+	}
+
+	MaxEdgeStrain = MaxStrain;
+}
+
+float FAirMeshClothSolver::ProjectEdgeConstraints(int32_t Begin, int32_t End)
+{
+	if (EdgeAlphaTilde > 0.0f)
+	{
+		return ProjectEdgeConstraintsCompliant(Begin, End);
+	}
+
+	auto& Positions = GetCurrentPositionArray();
+	float MaxStrain = 0.0f;
+
+	for (int32_t EdgeIndex = Begin; EdgeIndex < End; EdgeIndex++)
+	{
+		const auto& Edge = ClothEdges[EdgeIndex];
+
+		auto V0 = Positions.Get(Edge.VertexIndices[0]);
+		auto V1 = Positions.Get(Edge.VertexIndices[1]);
+
+		FClothVector Correction0, Correction1;
+		const float Strain = CalcEdgeCorrections(Edge, V0, V1, Correction0, Correction1);
+		MaxStrain = std::max(MaxStrain, std::fabs(Strain));
+		V0 += Correction0;
+		V1 += Correction1;
+
+		Positions.Set(Edge.VertexIndices[0], V0);
+		Positions.Set(Edge.VertexIndices[1], V1);
+	}
+
+	return MaxStrain;
+}
+
+float FAirMeshClothSolver::ProjectEdgeConstraintsCompliant(int32_t Begin, int32_t End)
+{
+	auto& Positions = GetCurrentPositionArray();
+	float MaxStrain = 0.0f;
+
+	for (int32_t EdgeIndex = Begin; EdgeIndex < End; EdgeIndex++)
+	{
+		const auto& Edge = ClothEdges[EdgeIndex];
+		const float Weight0 = SimulatedWeights[Edge.VertexIndices[0]];
+		const float Weight1 = SimulatedWeights[Edge.VertexIndices[1]];
+
+		auto V0 = Positions.Get(Edge.VertexIndices[0]);
+		auto V1 = Positions.Get(Edge.VertexIndices[1]);
+
+		auto Diff = V1 - V0;
+		float CurrentLength = Size(Diff);
+		float& Lambda = EdgeLambdas[EdgeIndex];
+
+		// Gradients are -Diff / CurrentLength for V0 and Diff / CurrentLength for V1
+		float DeltaLambda = (Edge.RestLength - CurrentLength - EdgeAlphaTilde * Lambda) / (Weight0 + Weight1 + EdgeAlphaTilde);
+		Lambda += DeltaLambda;
+
+		float Scale = DeltaLambda / CurrentLength;
+		Positions.Set(Edge.VertexIndices[0], V0 - Diff * (Scale * Weight0));
+		Positions.Set(Edge.VertexIndices[1], V1 + Diff * (Scale * Weight1));
+
+		MaxStrain = std::max(MaxStrain, std::fabs(CurrentLength - Edge.RestLength) / CurrentLength);
+	}
+
+	return MaxStrain;
+}
+
+void FAirMeshClothSolver::ProjectHierarchyLevels(uint32_t NumCoarseIterations)
+{
+	// Coarsest first, each level leaves finer stretch to the next
+	for (auto Level = HierarchyLevels.rbegin(); Level != HierarchyLevels.rend(); ++Level)
+	{
+		ProjectHierarchyLevel(*Level, NumCoarseIterations);
+	}
+}
+
+void FAirMeshClothSolver::ProjectHierarchyLevel(FHierarchyLevel& Level, uint32_t NumIterations)
+{
+	if (NumIterations == 0)
+	{
+		return;
+	}
+
+	auto& Positions = GetCurrentPositionArray();
+
+	for (size_t LevelVertex = 0; LevelVertex < Level.Vertices.size(); LevelVertex++)
+	{
+		Level.Corrections[LevelVertex] = Positions.Get(Level.Vertices[LevelVertex]);
+	}
+
+	for (uint32_t Iteration = 0; Iteration < NumIterations; Iteration++)
+	{
+		for (size_t Color = 0; Color + 1 < Level.EdgeColorOffsets.size(); Color++)
+		{
+			ForEachBatch(Level.EdgeColorOffsets[Color], Level.EdgeColorOffsets[Color + 1], [&Positions, &Level](int32_t Begin, int32_t End)
+			{
+				for (int32_t EdgeIndex = Begin; EdgeIndex < End; EdgeIndex++)
+				{
+					const auto& Edge = Level.Edges[EdgeIndex];
+
+					auto V0 = Positions.Get(Edge.VertexIndices[0]);
+					auto V1 = Positions.Get(Edge.VertexIndices[1]);
+
+					// Compressed coarse edges may be folded fine edges, which are left to bend
+					if (Size(V1 - V0) <= Edge.RestLength)
+					{
+						continue;
+					}
+
+					FClothVector Correction0, Correction1;
+					CalcEdgeCorrections(Edge, V0, V1, Correction0, Correction1);
+					Positions.Set(Edge.VertexIndices[0], V0 + Correction0);
+					Positions.Set(Edge.VertexIndices[1], V1 + Correction1);
+				}
+			});
+		}
+	}
+
+	for (size_t LevelVertex = 0; LevelVertex < Level.Vertices.size(); LevelVertex++)
+	{
+		Level.Corrections[LevelVertex] = Positions.Get(Level.Vertices[LevelVertex]) - Level.Corrections[LevelVertex];
+	}
+
+	// Each vertex is prolongated by a single cell
+	ForEachBatch(0, (int32_t)Level.Prolongations.size(), [&Positions, &Level](int32_t Begin, int32_t End)
+	{
+		for (int32_t ProlongationIndex = Begin; ProlongationIndex < End; ProlongationIndex++)
+		{
+			const auto& Prolongation = Level.Prolongations[ProlongationIndex];
+
+			FClothVector Correction{ 0.0f, 0.0f, 0.0f };
+			for (int32_t Corner = 0; Corner < 4; Corner++)
+			{
+				Correction += Level.Corrections[Prolongation.Corners[Corner]] * Prolongation.Weights[Corner];
+			}
+
+			Positions.Set(Prolongation.VertexIndex, Positions.Get(Prolongation.VertexIndex) + Correction);
+		}
+	});
+}
+
+void FAirMeshClothSolver::ProjectEdgeConstraintsJacobi()
+{
+	const auto& Positions = GetCurrentPositionArray();
+
+	if (EdgeJacobiBuffer.VertexSlotOffsets.empty())
+	{
+		BuildJacobiSlots<2>(ClothEdges, Positions.Num(),
+			EdgeJacobiBuffer.Deltas, EdgeJacobiBuffer.VertexSlotOffsets, EdgeJacobiBuffer.VertexSlots);
+	}
+
+	std::atomic<float> MaxStrain(0.0f);
+
+	ForEachBatch(0, (int32_t)ClothEdges.size(), [this, &Positions, &MaxStrain](int32_t Begin, int32_t End)
+	{
+		float BatchMaxStrain = 0.0f;
+
+		for (int32_t EdgeIndex = Begin; EdgeIndex < End; EdgeIndex++)
+		{
+			const auto& Edge = ClothEdges[EdgeIndex];
+			auto* Deltas = &EdgeJacobiBuffer.Deltas[EdgeIndex * 2];
+
+			const float Strain = CalcEdgeCorrections(Edge, Positions.Get(Edge.VertexIndices[0]), Positions.Get(Edge.VertexIndices[1]),
+				Deltas[0].Correction, Deltas[1].Correction);
+			BatchMaxStrain = std::max(BatchMaxStrain, std::fabs(Strain));
+			Deltas[0].Count = 1.0f;
+			Deltas[1].Count = 1.0f;
+		}
+
+		AtomicMax(MaxStrain, BatchMaxStrain);
+	});
+
+	MaxEdgeStrain = MaxStrain;
+	ApplyJacobiDeltas(EdgeJacobiBuffer);
+}
+
+void FAirMeshClothSolver::ProjectAirTetrahedraJacobi()
+{
+	const auto& Positions = GetCurrentPositionArray();
+
+	if (AirTetrahedronJacobiBuffer.VertexSlotOffsets.empty())
+	{
+		BuildJacobiSlots<4>(AirTetrahedra, Positions.Num(),
+			AirTetrahedronJacobiBuffer.Deltas, AirTetrahedronJacobiBuffer.VertexSlotOffsets, AirTetrahedronJacobiBuffer.VertexSlots);
+	}
+
+	NumActiveAirTetrahedra = (int32_t)AirTetrahedra.size();
+
+	std::atomic<int32_t> NumInverted(0);
+
+	ForEachBatch(0, (int32_t)AirTetrahedra.size(), [this, &Positions, &NumInverted](int32_t Begin, int32_t End)
+	{
+		int32_t BatchNumInverted = 0;
+
+		for (int32_t TetIndex = Begin; TetIndex < End; TetIndex++)
+		{
+			const int32_t* TetIndices = AirTetrahedra[TetIndex].VertexIndices;
+			auto* Deltas = &AirTetrahedronJacobiBuffer.Deltas[TetIndex * 4];
+
+			FClothVector P[4];
+			float Weights[4];
+			FClothVector Corrections[4];
+			for (int32_t Vertex = 0; Vertex < 4; Vertex++)
+			{
+				P[Vertex] = Positions.Get(TetIndices[Vertex]);
+				Weights[Vertex] = SimulatedWeights[TetIndices[Vertex]];
+			}
+
+			const bool bInverted = CalcAirTetrahedronCorrections(P, Weights, Corrections);
+			for (int32_t Vertex = 0; Vertex < 4; Vertex++)
+			{
+				Deltas[Vertex].Correction = bInverted ? Corrections[Vertex] : FClothVector{ 0.0f, 0.0f, 0.0f };
+				Deltas[Vertex].Count = bInverted ? 1.0f : 0.0f;
+			}
+			BatchNumInverted += bInverted ? 1 : 0;
+		}
+
+		NumInverted += BatchNumInverted;
+	});
+
+	NumInvertedAirTetrahedra = NumInverted;
+
+	ApplyJacobiDeltas(AirTetrahedronJacobiBuffer);
+}
+
+void FAirMeshClothSolver::ApplyJacobiDeltas(const FJacobiBuffer& Buffer)
+{
+	auto& Positions = GetCurrentPositionArray();
+
+	ForEachBatch(0, Positions.Num(), [&Positions, &Buffer](int32_t Begin, int32_t End)
+	{
+		for (int32_t VertexIndex = Begin; VertexIndex < End; VertexIndex++)
+		{
+			FClothVector Sum{ 0.0f, 0.0f, 0.0f };
+			float Count = 0.0f;
+
+			for (int32_t SlotIndex = Buffer.VertexSlotOffsets[VertexIndex]; SlotIndex < Buffer.VertexSlotOffsets[VertexIndex + 1]; SlotIndex++)
+			{
+				const auto& Delta = Buffer.Deltas[Buffer.VertexSlots[SlotIndex]];
+				Sum += Delta.Correction;
+				Count += Delta.Count;
+			}
+
+			if (Count > 0.0f)
+			{
+				Positions.Set(VertexIndex, Positions.Get(VertexIndex) + Sum * (1.0f / Count));
+			}
+		}
+	});
+}
+
+namespace
+{
+	float GetMaxDisplacementSquared(const FClothPositionBuffer& Positions, const FClothPositionBuffer& ReferencePositions)
+	{
+		const float* X = Positions.X.data();
+		const float* Y = Positions.Y.data();
+		const float* Z = Positions.Z.data();
+		const float* ReferenceX = ReferencePositions.X.data();
+		const float* ReferenceY = ReferencePositions.Y.data();
+		const float* ReferenceZ = ReferencePositions.Z.data();
+
+		// Padding moves as pinned vertices do, which only makes the check more conservative
+		FClothSimdFloat MaxDisplacementSquared = SimdSet(0.0f);
+		for (int32_t VertexIndex = 0; VertexIndex < Positions.PaddedNum(); VertexIndex += ClothSimdWidth)
+		{
+			FClothSimdFloat DX = SimdSub(SimdLoad(X + VertexIndex), SimdLoad(ReferenceX + VertexIndex));
+			FClothSimdFloat DY = SimdSub(SimdLoad(Y + VertexIndex), SimdLoad(ReferenceY + VertexIndex));
+			FClothSimdFloat DZ = SimdSub(SimdLoad(Z + VertexIndex), SimdLoad(ReferenceZ + VertexIndex));
+			FClothSimdFloat DisplacementSquared = SimdAdd(SimdAdd(SimdMul(DX, DX), SimdMul(DY, DY)), SimdMul(DZ, DZ));
+			MaxDisplacementSquared = SimdMax(MaxDisplacementSquared, DisplacementSquared);
+		}
+
+		return SimdHorizontalMax(MaxDisplacementSquared);
+	}
+
+	/**
+	 * Distance each vertex can move while the tetrahedron is guaranteed to stay positive, negative if it is not positive.
+	 * Moving vertices by less than M changes each edge from P3 by less than 2M, and the determinant is trilinear,
+	 * so it changes less than (L0 + 2M)(L1 + 2M)(L2 + 2M) - L0 L1 L2 = 2M S2 + 4M^2 S1 + 8M^3.
+	 */
+	float CalcInversionSlack(const FClothPositionBuffer& Positions, const FClothTetrahedron& Tet)
+	{
+		auto P3 = Positions.Get(Tet.VertexIndices[3]);
+		auto E0 = Positions.Get(Tet.VertexIndices[0]) - P3;
+		auto E1 = Positions.Get(Tet.VertexIndices[1]) - P3;
+		auto E2 = Positions.Get(Tet.VertexIndices[2]) - P3;
+
+		float L0 = Size(E0);
+		float L1 = Size(E1);
+		float L2 = Size(E2);
+		float S1 = L0 + L1 + L2;
+		float S2 = L0 * L1 + L1 * L2 + L2 * L0;
+
+		// Slack for rounding errors of the volume
+		float Volume = DotProduct(E0, CrossProduct(E1, E2)) - L0 * L1 * L2 * 1e-5f;
+		if (Volume <= 0.0f || S2 <= 0.0f)
+		{
+			return -1.0f;
+		}
+
+		// Linear term alone overestimates the slack, and higher order terms evaluated with it make it conservative
+		float MaxSlack = Volume / (2.0f * S2);
+		return Volume / (2.0f * S2 + 4.0f * MaxSlack * S1 + 8.0f * MaxSlack * MaxSlack);
+	}
+}
+
+float FAirMeshClothSolver::CalcMaxStepDisplacement() const
+{
+	return std::sqrt(GetMaxDisplacementSquared(GetCurrentPositionArray(), GetPreviousPositionArray()));
+}
+
+bool FAirMeshClothSolver::UpdateActiveAirTetrahedra(float& OutDisplacementSquared)
+{
+	if (NumPassesToSkipCulling > 0)
+	{
+		NumPassesToSkipCulling--;
+		return false;
+	}
+
+	const auto& Positions = GetCurrentPositionArray();
+
+	if (bActiveAirTetrahedraValid)
+	{
+		OutDisplacementSquared = GetMaxDisplacementSquared(Positions, CullingReferencePositions);
+		if (OutDisplacementSquared < AirTetrahedronCullingMargin * AirTetrahedronCullingMargin)
+		{
+			NumPassesSinceCullingUpdate++;
+			return true;
+		}
+
+		// Cloth moves too fast to benefit from culling, rebuilding on every pass costs more than projecting all
+		if (NumPassesSinceCullingUpdate == 0)
+		{
+			bActiveAirTetrahedraValid = false;
+			NumPassesToSkipCulling = AirTetrahedronCullingBackoffPasses;
+			return false;
+		}
+	}
+
+	CullingReferencePositions = Positions;
+
+	AirTetrahedronSlacks.resize(AirTetrahedra.size());
+	for (size_t TetIndex = 0; TetIndex < AirTetrahedra.size(); TetIndex++)
+	{
+		AirTetrahedronSlacks[TetIndex] = CalcInversionSlack(Positions, AirTetrahedra[TetIndex]);
+	}
+
+	// Margin is half the median slack of positive tetrahedra, so at least half of them are culled
+	std::vector<float> PositiveSlacks;
+	for (float Slack : AirTetrahedronSlacks)
+	{
+		if (Slack > 0.0f)
+		{
+			PositiveSlacks.push_back(Slack);
+		}
+	}
+
+	AirTetrahedronCullingMargin = 0.0f;
+	if (!PositiveSlacks.empty())
+	{
+		auto Median = PositiveSlacks.begin() + PositiveSlacks.size() / 2;
+		std::nth_element(PositiveSlacks.begin(), Median, PositiveSlacks.end());
+		AirTetrahedronCullingMargin = *Median * 0.5f;
+	}
+
+	ActiveAirTetrahedra.clear();
+	ActiveAirTetrahedronColorOffsets.assign(1, 0);
+
+	for (int32_t Color = 0; Color < GetNumAirTetrahedronColors(); Color++)
+	{
+		for (int32_t TetIndex = AirTetrahedronColorOffsets[Color]; TetIndex < AirTetrahedronColorOffsets[Color + 1]; TetIndex++)
+		{
+			if (AirTetrahedronSlacks[TetIndex] < AirTetrahedronCullingMargin || AirTetrahedronSlacks[TetIndex] <= 0.0f)
+			{
+				ActiveAirTetrahedra.push_back(AirTetrahedra[TetIndex]);
+			}
+		}
+
+		ActiveAirTetrahedronColorOffsets.push_back((int32_t)ActiveAirTetrahedra.size());
+	}
+
+	bActiveAirTetrahedraValid = true;
+	NumPassesSinceCullingUpdate = 0;
+	OutDisplacementSquared = 0.0f;
+	return true;
+}
+
+void FAirMeshClothSolver::ProjectAirTetrahedra()
+{
+	const FClothTetrahedron* Tetrahedra = AirTetrahedra.data();
+	const std::vector<int32_t>* ColorOffsets = &AirTetrahedronColorOffsets;
+
+	// Displacement from the culling reference, grown by corrections of active tetrahedra during the pass
+	float DisplacementSquared = 0.0f;
+	bool bCulled = bCullAirTetrahedra && AirTetrahedronAlphaTilde == 0.0f && UpdateActiveAirTetrahedra(DisplacementSquared);
+	std::atomic<float> MovedDisplacementSquared(DisplacementSquared);
+
+	if (bCulled)
+	{
+		Tetrahedra = ActiveAirTetrahedra.data();
+		ColorOffsets = &ActiveAirTetrahedronColorOffsets;
+	}
+
+	// Culled tetrahedra are positive when they would be projected, so not counting them gives the same count as
+	// projecting all of them, and does not change when Step() stops early
+	std::atomic<int32_t> NumInverted(0);
+	NumActiveAirTetrahedra = 0;
+
+	// Both lists have the same colors, and tetrahedra of a color share no vertex.
+	// So checking the margin before each color guarantees culled tetrahedra are positive when they would be projected,
+	// and results are the same as projecting all of them.
+	for (int32_t Color = 0; Color < GetNumAirTetrahedronColors(); Color++)
+	{
+		if (bCulled && MovedDisplacementSquared >= AirTetrahedronCullingMargin * AirTetrahedronCullingMargin)
+		{
+			// Rebuilt or suspended on the next pass
+			bCulled = false;
+			Tetrahedra = AirTetrahedra.data();
+			ColorOffsets = &AirTetrahedronColorOffsets;
+		}
+
+		const int32_t ColorBegin = (*ColorOffsets)[Color];
+		const int32_t ColorEnd = (*ColorOffsets)[Color + 1];
+		const bool bTracksDisplacement = bCulled;
+
+		ForEachBatch(ColorBegin, ColorEnd, [this, Tetrahedra, bTracksDisplacement, &NumInverted, &MovedDisplacementSquared](int32_t Begin, int32_t End)
+		{
+			float BatchDisplacementSquared = 0.0f;
+			NumInverted += ProjectAirTetrahedra(Tetrahedra, Begin, End, bTracksDisplacement ? &BatchDisplacementSquared : nullptr);
+			AtomicMax(MovedDisplacementSquared, BatchDisplacementSquared);
+		});
+
+		NumActiveAirTetrahedra += ColorEnd - ColorBegin;
+	}
+
+	NumInvertedAirTetrahedra = NumInverted;
+}
+
+int32_t FAirMeshClothSolver::ProjectAirTetrahedra(const FClothTetrahedron* Tetrahedra, int32_t Begin, int32_t End, float* OutMaxDisplacementSquared)
+{
+	auto& Positions = GetCurrentPositionArray();
+	int32_t NumInverted = 0;
+
+	// Multipliers are used only when all tetrahedra are projected
+	float* Lambdas = AirTetrahedronAlphaTilde > 0.0f ? AirTetrahedronLambdas.data() : nullptr;
+
+	for (int32_t TetIndex = Begin; TetIndex < End; TetIndex++)
+	{
+		const int32_t* TetIndices = Tetrahedra[TetIndex].VertexIndices;
+
+		FClothVector P[4];
+		float Weights[4];
+		FClothVector Corrections[4];
+		for (int32_t Vertex = 0; Vertex < 4; Vertex++)
+		{
+			P[Vertex] = Positions.Get(TetIndices[Vertex]);
+			Weights[Vertex] = SimulatedWeights[TetIndices[Vertex]];
+		}
+
+		if (!CalcAirTetrahedronCorrections(P, Weights, Corrections, AirTetrahedronAlphaTilde, Lambdas ? &Lambdas[TetIndex] : nullptr))
+		{
+			continue;
+		}
+
+		for (int32_t Vertex = 0; Vertex < 4; Vertex++)
+		{
+			Positions.Set(TetIndices[Vertex], P[Vertex] + Corrections[Vertex]);
+		}
+		NumInverted++;
+
+		if (OutMaxDisplacementSquared)
+		{
+			for (int32_t Vertex = 0; Vertex < 4; Vertex++)
+			{
+				const FClothVector Displacement = P[Vertex] + Corrections[Vertex] - CullingReferencePositions.Get(TetIndices[Vertex]);
+				*OutMaxDisplacementSquared = std::max(*OutMaxDisplacementSquared, SizeSquared(Displacement));
+			}
+		}
+	}
+
+	return NumInverted;
+}
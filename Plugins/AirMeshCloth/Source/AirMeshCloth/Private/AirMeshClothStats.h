@@ -0,0 +1,17 @@
+// Copyright 2016 massanoori. All Rights Reserved.
+
+#pragma once
+
+DECLARE_STATS_GROUP(TEXT("AirMeshCloth"), STATGROUP_AirMeshCloth, STATCAT_Advanced);
+
+// Number of cloths in each simulation LOD tier, counted every frame
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("LOD Full"), STAT_AirMeshClothLODFull, STATGROUP_AirMeshCloth, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("LOD Reduced"), STAT_AirMeshClothLODReduced, STATGROUP_AirMeshCloth, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("LOD Low"), STAT_AirMeshClothLODLow, STATGROUP_AirMeshCloth, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("LOD Frozen"), STAT_AirMeshClothLODFrozen, STATGROUP_AirMeshCloth, );
+
+// Number of sleeping cloths, which are not counted in LOD tiers
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Sleeping"), STAT_AirMeshClothSleeping, STATGROUP_AirMeshCloth, );
+
+// Constraint iterations taken by all cloths, fewer than requested when stopped by StrainTolerance
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Constraint Iterations"), STAT_AirMeshClothIterations, STATGROUP_AirMeshCloth, );
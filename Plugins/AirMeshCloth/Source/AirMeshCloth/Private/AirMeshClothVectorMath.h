@@ -0,0 +1,80 @@
+// Copyright 2016 massanoori. All Rights Reserved.
+
+#pragma once
+
+// Minimal vector math for engine-independent code, mirrors FVector operations.
+
+#include "AirMeshClothSolver.h"
+
+#include <cmath>
+
+inline FClothVector operator+(const FClothVector& A, const FClothVector& B)
+{
+	return FClothVector{ A.X + B.X, A.Y + B.Y, A.Z + B.Z };
+}
+
+inline FClothVector operator-(const FClothVector& A, const FClothVector& B)
+{
+	return FClothVector{ A.X - B.X, A.Y - B.Y, A.Z - B.Z };
+}
+
+inline FClothVector operator-(const FClothVector& A)
+{
+	return FClothVector{ -A.X, -A.Y, -A.Z };
+}
+
+inline FClothVector operator*(const FClothVector& A, float Scale)
+{
+	return FClothVector{ A.X * Scale, A.Y * Scale, A.Z * Scale };
+}
+
+inline FClothVector operator*(float Scale, const FClothVector& A)
+{
+	return A * Scale;
+}
+
+inline FClothVector& operator+=(FClothVector& A, const FClothVector& B)
+{
+	A.X += B.X; A.Y += B.Y; A.Z += B.Z;
+	return A;
+}
+
+inline FClothVector& operator-=(FClothVector& A, const FClothVector& B)
+{
+	A.X -= B.X; A.Y -= B.Y; A.Z -= B.Z;
+	return A;
+}
+
+inline float DotProduct(const FClothVector& A, const FClothVector& B)
+{
+	return A.X * B.X + A.Y * B.Y + A.Z * B.Z;
+}
+
+inline FClothVector CrossProduct(const FClothVector& A, const FClothVector& B)
+{
+	return FClothVector{
+		A.Y * B.Z - A.Z * B.Y,
+		A.Z * B.X - A.X * B.Z,
+		A.X * B.Y - A.Y * B.X,
+	};
+}
+
+inline float SizeSquared(const FClothVector& A)
+{
+	return DotProduct(A, A);
+}
+
+inline float Size(const FClothVector& A)
+{
+	return std::sqrt(SizeSquared(A));
+}
+
+inline FClothVector GetSafeNormal(const FClothVector& A, float Tolerance = 1.e-8f)
+{
+	const float SquareSum = SizeSquared(A);
+	if (SquareSum < Tolerance)
+	{
+		return FClothVector{ 0.0f, 0.0f, 0.0f };
+	}
+	return A * (1.0f / std::sqrt(SquareSum));
+}
@@ -3,17 +3,11 @@
 #pragma once
 
 #include "Components/MeshComponent.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "AirMeshClothSolver.h"
 #include "AirMeshClothComponent.generated.h"
 
 
-struct FClothEdge
-{
-	uint32 VertexIndices[2];
-	float Weights[2];
-	float RestLength;
-};
-
-
 UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
 class AIRMESHCLOTH_API UAirMeshClothComponent : public UMeshComponent
 {
@@ -35,6 +29,13 @@ public:
 
 	virtual void OnRegister() override;
 
+	virtual void OnUnregister() override;
+
+protected:
+	virtual void RegisterComponentTickFunctions(bool bRegister) override;
+
+public:
+
 	virtual int32 GetNumMaterials() const override
 	{
 		return NumLayers;
@@ -42,6 +43,29 @@ public:
 
 	virtual FBoxSphereBounds CalcBounds(const FTransform& LocalToWorld) const override;
 
+	// Resume simulation of a sleeping cloth, e.g. when a force is applied to it
+	UFUNCTION(BlueprintCallable, Category = "AirMesh")
+	void WakeUp();
+
+	UFUNCTION(BlueprintCallable, Category = "AirMesh")
+	bool IsSleeping() const
+	{
+		return bSleeping;
+	}
+
+	// Largest distance a vertex was moved by the last constraint iteration, available with Chebyshev acceleration
+	UFUNCTION(BlueprintCallable, Category = "AirMesh")
+	float GetLastIterationDisplacement() const
+	{
+		return LastIterationDisplacement;
+	}
+
+	// Pushes vertices within Radius away from Origin, pulls them if Strength is negative. Wakes up the cloth.
+	// Strength is the acceleration at Origin, fading out linearly to Radius. It is applied by a single substep of the next step
+	// which has one, even with several substeps, so vertices gain velocity by Strength times the substep time.
+	UFUNCTION(BlueprintCallable, Category = "AirMesh")
+	void AddRadialForce(FVector Origin, float Strength, float Radius);
+
 	UPROPERTY(EditAnywhere, Category = "AirMesh", meta = (ClampMin = 1, UIMin = 1, UIMax = 64))
 	uint32 ResolutionX;
 
@@ -57,40 +81,211 @@ public:
 	UPROPERTY(EditAnywhere, Category = "AirMesh", meta = (ClampMin = 1, UIMin = 1, UIMax = 16))
 	uint32 NumLayers;
 
+	// Iterations per step, the maximum if StrainTolerance is not 0
 	UPROPERTY(EditAnywhere, Category = "AirMesh", meta = (ClampMin = 1, UIMin = 1, UIMax = 16))
 	uint32 NumIterations;
 
+	// Stop iterating after MinIterations once no edge is strained more than this ratio and no air tetrahedron is inverted. If 0, always iterates NumIterations times.
+	UPROPERTY(EditAnywhere, Category = "AirMesh", meta = (ClampMin = 0.0, UIMin = 0.0, UIMax = 0.1))
+	float StrainTolerance;
+
+	UPROPERTY(EditAnywhere, Category = "AirMesh", meta = (ClampMin = 1, UIMin = 1, UIMax = 16))
+	uint32 MinIterations;
+
 	UPROPERTY(EditAnywhere, Category = "AirMesh", meta = (ClampMin = 0.0, UIMin = 0.0, UIMax = 1.0))
 	float Damping;
 
+	// Coarse levels of edges, each connecting every other vertex of the finer one. Removes stretch of large cloths with fewer NumIterations.
+	UPROPERTY(EditAnywhere, Category = "AirMesh", meta = (ClampMin = 0, UIMin = 0, UIMax = 6))
+	uint32 NumHierarchyLevels;
+
+	// Iterations of each coarse level, projected before NumIterations
+	UPROPERTY(EditAnywhere, Category = "AirMesh", meta = (ClampMin = 0, UIMin = 0, UIMax = 16))
+	uint32 NumCoarseIterations;
+
+	// Inverse stiffness of edges, which keeps the same softness across NumIterations, timesteps and LOD tiers.
+	// If 0, edges are as stiff as NumIterations allows.
+	UPROPERTY(EditAnywhere, Category = "AirMesh", meta = (ClampMin = 0.0, UIMin = 0.0, UIMax = 0.001))
+	float EdgeCompliance;
+
+	// Inverse stiffness of air mesh against inversion, same as EdgeCompliance. Air tetrahedra are not culled if not 0.
+	UPROPERTY(EditAnywhere, Category = "AirMesh", meta = (ClampMin = 0.0, UIMin = 0.0, UIMax = 0.001))
+	float AirMeshCompliance;
+
+	// Accelerates convergence of NumIterations by Chebyshev extrapolation if not 0, e.g. 0.9 halves iterations of a hanging cloth.
+	// Too high values diverge, the sooner the fewer NumIterations.
+	UPROPERTY(EditAnywhere, Category = "AirMesh", meta = (ClampMin = 0.0, ClampMax = 0.99, UIMin = 0.0, UIMax = 0.99))
+	float ChebyshevSpectralRadius;
+
+	// Acceleration in addition to gravity, e.g. steady wind
+	UPROPERTY(EditAnywhere, Category = "AirMesh Forces")
+	FVector WindAcceleration;
+
+	// Largest acceleration by turbulence, which varies smoothly over the cloth and over time. Disabled if 0.
+	UPROPERTY(EditAnywhere, Category = "AirMesh Forces", meta = (ClampMin = 0.0, UIMin = 0.0, UIMax = 2000.0))
+	float TurbulenceAmplitude;
+
+	// Distance between gusts of turbulence
+	UPROPERTY(EditAnywhere, Category = "AirMesh Forces", meta = (ClampMin = 1.0, UIMin = 1.0, UIMax = 1000.0))
+	float TurbulenceWavelength;
+
+	// How fast turbulence changes, in radians per second
+	UPROPERTY(EditAnywhere, Category = "AirMesh Forces", meta = (ClampMin = 0.0, UIMin = 0.0, UIMax = 10.0))
+	float TurbulenceSpeed;
+
+	// Simulate by this fixed timestep and interpolate rendered positions. If 0, steps once per tick by DeltaTime clamped to 1/30.
+	UPROPERTY(EditAnywhere, Category = "AirMesh", meta = (ClampMin = 0.0, UIMin = 0.0, UIMax = 0.1))
+	float FixedTimestep;
+
+	// Fixed timesteps per tick are limited to this, and the simulation slows down beyond it
+	UPROPERTY(EditAnywhere, Category = "AirMesh", meta = (ClampMin = 1, UIMin = 1, UIMax = 16))
+	uint32 MaxSubsteps;
+
 	UPROPERTY(EditAnywhere, Category = "AirMesh", meta = (ClampMin = 0.0, UIMin = 0.0, UIMax = 100.0))
 	float LayerInterval;
 
 	UPROPERTY(EditAnywhere, Category = "AirMesh")
 	bool bUseAirMesh;
 
+	// Project constraints on worker threads, results are the same as single-threaded
+	UPROPERTY(EditAnywhere, Category = "AirMesh")
+	bool bUseParallelSolver;
+
+	// Skip air tetrahedra which cannot be inverted until the cloth moves enough, results are the same.
+	// Speeds up resting cloth, and costs up to about 15% on cloth that keeps moving.
+	UPROPERTY(EditAnywhere, Category = "AirMesh")
+	bool bCullAirTetrahedra;
+
+	// Project constraints independently and average their corrections, scales better with cores but needs more iterations
+	UPROPERTY(EditAnywhere, Category = "AirMesh")
+	bool bUseJacobiSolver;
+
+	// Store layers of each grid point together on registration, speeds up air mesh of many layers but slows down edges
+	UPROPERTY(EditAnywhere, Category = "AirMesh")
+	bool bReorderVertices;
+
+	// Step the solver on a worker thread, which is joined on the next tick. Rendered cloth lags a frame behind.
+	UPROPERTY(EditAnywhere, Category = "AirMesh")
+	bool bSimulateAsync;
+
+	// Step together with other batched cloths of the world on worker threads, joined once per frame
+	UPROPERTY(EditAnywhere, Category = "AirMesh")
+	bool bBatchSimulation;
+
+	// Stop simulating and uploading vertices when no vertex moves more than SleepDisplacementThreshold for SleepSteps steps.
+	// Wakes up when the component moves or WakeUp() is called.
+	UPROPERTY(EditAnywhere, Category = "AirMesh")
+	bool bEnableSleeping;
+
+	UPROPERTY(EditAnywhere, Category = "AirMesh", meta = (ClampMin = 0.0, UIMin = 0.0, UIMax = 1.0))
+	float SleepDisplacementThreshold;
+
+	UPROPERTY(EditAnywhere, Category = "AirMesh", meta = (ClampMin = 1, UIMin = 1, UIMax = 120))
+	uint32 SleepSteps;
+
+	// Lower simulation cost of cloths that are small on screen or not rendered
+	UPROPERTY(EditAnywhere, Category = "AirMesh LOD")
+	bool bEnableSimulationLOD;
+
+	// Below this screen size, iterations are halved and air mesh is not projected
+	UPROPERTY(EditAnywhere, Category = "AirMesh LOD", meta = (ClampMin = 0.0, UIMin = 0.0, UIMax = 1.0))
+	float ReducedLODScreenSize;
+
+	// Below this screen size, additionally steps only once in LowLODTickInterval ticks, by the time of those ticks
+	UPROPERTY(EditAnywhere, Category = "AirMesh LOD", meta = (ClampMin = 0.0, UIMin = 0.0, UIMax = 1.0))
+	float LowLODScreenSize;
+
+	UPROPERTY(EditAnywhere, Category = "AirMesh LOD", meta = (ClampMin = 1, UIMin = 1, UIMax = 8))
+	uint32 LowLODTickInterval;
+
+	// Simulation is frozen when not rendered for this time in seconds
+	UPROPERTY(EditAnywhere, Category = "AirMesh LOD", meta = (ClampMin = 0.0, UIMin = 0.0, UIMax = 10.0))
+	float FreezeAfterNotRenderedTime;
+
+	// Screen size has to exceed a threshold by this ratio to return to a finer tier
+	UPROPERTY(EditAnywhere, Category = "AirMesh LOD", meta = (ClampMin = 0.0, UIMin = 0.0, UIMax = 1.0))
+	float LODHysteresis;
+
 	virtual void Serialize(FArchive& Ar) override;
 
 private:
-	TArray<FVector> SimulatedPositions[2];
-	TArray<float> SimulatedWeights;
-	TArray<FClothEdge> ClothEdges;
+	FAirMeshClothSolver Solver;
+
+	// Kept here to be serialized, and copied to the solver on registration
 	TArray<TStaticArray<int32, 4u>> AirTetrahedra;
-	int32 CurrentPositionArrayIndex;
+
+	// Tetrahedra are sorted by graph color, so that each color can be projected in parallel.
+	// Offsets are saved to avoid coloring again on load.
+	TArray<int32> AirTetrahedronColorOffsets;
 	FTransform PreviousTransform;
 
-	TArray<FVector>& GetCurrentPositionArray()
-	{
-		return SimulatedPositions[CurrentPositionArrayIndex];
-	}
+	// Fixed timestep simulation, see FixedTimestep. Alpha of the positions rendered after the last step.
+	FClothTimeAccumulator TimeAccumulator;
+	float RenderInterpolationAlpha;
 
-	const TArray<FVector>& GetCurrentPositionArray() const
-	{
-		return SimulatedPositions[CurrentPositionArrayIndex];
-	}
+	// Asynchronous simulation, see bSimulateAsync.
+	// The task writes local space positions and world space bounds to Async*, which are swapped with Published* on join.
+	FGraphEventRef SimulationTask;
+	TArray<FVector> AsyncRenderPositions;
+	TArray<FVector> PublishedRenderPositions;
+	FBox AsyncBounds;
+	FBox PublishedBounds;
+
+	// Time of the last step on a worker thread
+	uint32 LastSimulationCycles;
 
-	TArray<FVector>& GetPreviousPositionArray()
+	// Whether stepped by FAirMeshClothManager instead of ticking, and whether the tick was enabled before, which is restored on unregister
+	bool bRegisteredToBatch;
+	bool bTickEnabledBeforeBatch;
+
+	enum class ESimulationLOD : uint8
 	{
-		return SimulatedPositions[CurrentPositionArrayIndex ^ 1];
-	}
+		Full,
+		Reduced,
+		Low,
+		Frozen,
+	};
+
+	ESimulationLOD SimulationLOD;
+
+	// Sleeping, see bEnableSleeping. Displacement of the last step is measured on the thread which stepped.
+	bool bSleeping;
+	uint32 NumSettledSteps;
+	float LastStepDisplacement;
+
+	// Copied from the solver when a step is finished
+	float LastIterationDisplacement;
+
+	// Added by AddRadialForce() and passed to the solver by the next step which has a substep
+	TArray<FClothForceField> PendingRadialForces;
+
+	/** Reads results of a step on the game thread, after it has been joined if asynchronous */
+	void OnStepFinished();
+
+	void UpdateSleepState();
+
+	// Ticks and their time skipped by the low LOD tier
+	uint32 NumSkippedTicks;
+	float SkippedDeltaTime;
+
+	void UpdateSimulationLOD();
+	float CalcScreenSize() const;
+
+	FClothGridDesc GetGridDesc() const;
+
+	/**
+	 * Parameters of the next step, pinned vertices are moved to the current component transform.
+	 * Returns false if simulation LOD skips this tick.
+	 */
+	bool PrepareStep(float DeltaTime, FClothStepParams& OutParams);
+
+	void StartSimulationTask(const FClothStepParams& Params);
+	void WaitForSimulationTask();
+
+	/** Publishes a step finished on a worker thread */
+	void FinishStep();
+
+	friend class FAirMeshClothManager;
+
+	void ColorAirTetrahedra();
 };
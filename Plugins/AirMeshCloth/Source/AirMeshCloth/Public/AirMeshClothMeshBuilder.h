@@ -0,0 +1,49 @@
+// Copyright 2016 massanoori. All Rights Reserved.
+
+#pragma once
+
+// This header must not depend on the engine, same as AirMeshClothSolver.h.
+
+#include "AirMeshClothSolver.h"
+
+/** Same layout with FPackedNormal */
+struct FClothPackedNormal
+{
+	uint8_t X, Y, Z, W;
+};
+
+/** Attributes of a render vertex which change with simulation, uploaded every frame */
+struct FClothMeshVertex
+{
+	FClothVector Position;
+	FClothPackedNormal TangentX;
+	FClothPackedNormal TangentZ;
+};
+
+/** Attributes of a render vertex which are constant for the grid, uploaded once */
+struct FClothMeshStaticVertex
+{
+	float TextureCoordinate[2];
+	uint8_t Color[4]; // BGRA, same as FColor
+};
+
+/**
+ * Builds render vertices with tangents from local space positions of the grid.
+ * Tangents are central differences of neighbors along rows and columns, one-sided on borders, computed by SIMD.
+ *
+ * @param Grid Grid which the positions are generated from
+ * @param Positions Positions of all layers, GetNumVerticesPerLayer() * NumLayers elements
+ * @param OutVertices Destination, must have room for GetNumVerticesPerLayer() * NumLayers elements.
+ *                    Only written, in order, so it can be a locked write-only buffer.
+ * @param bFastNormalize Normalize by approximate reciprocal square root, which may change packed components by one
+ */
+void BuildClothMeshVertices(const FClothGridDesc& Grid, const FClothVector* Positions, FClothMeshVertex* OutVertices, bool bFastNormalize = false);
+
+/**
+ * Same as BuildClothMeshVertices(), but builds only NumRows rows from FirstRow, counted over all layers (see FClothGridDesc::GetNumRows()).
+ * Reads neighboring rows of Positions and writes only vertices of the rows, so disjoint ranges can be built in parallel.
+ */
+void BuildClothMeshVertexRows(const FClothGridDesc& Grid, const FClothVector* Positions, FClothMeshVertex* OutVertices, int32_t FirstRow, int32_t NumRows, bool bFastNormalize = false);
+
+/** Builds texture coordinates and colors of the grid, same element count as BuildClothMeshVertices() */
+void BuildClothMeshStaticVertices(const FClothGridDesc& Grid, FClothMeshStaticVertex* OutVertices);
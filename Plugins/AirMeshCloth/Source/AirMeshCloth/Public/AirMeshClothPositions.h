@@ -0,0 +1,132 @@
+// Copyright 2016 massanoori. All Rights Reserved.
+
+#pragma once
+
+// This header must not depend on the engine, same as AirMeshClothSolver.h.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <malloc.h>
+#endif
+
+/** Minimal std allocator returning memory aligned for SIMD loads */
+template <typename T, size_t Alignment>
+class TClothAlignedAllocator
+{
+public:
+	typedef T value_type;
+
+	template <typename U>
+	struct rebind
+	{
+		typedef TClothAlignedAllocator<U, Alignment> other;
+	};
+
+	TClothAlignedAllocator() {}
+
+	template <typename U>
+	TClothAlignedAllocator(const TClothAlignedAllocator<U, Alignment>&) {}
+
+	T* allocate(size_t Count)
+	{
+#if defined(_MSC_VER)
+		void* Memory = _aligned_malloc(Count * sizeof(T), Alignment);
+#else
+		void* Memory = nullptr;
+		if (posix_memalign(&Memory, Alignment, Count * sizeof(T)) != 0)
+		{
+			Memory = nullptr;
+		}
+#endif
+		if (Memory == nullptr && Count > 0)
+		{
+			// The engine is built without exceptions
+			std::abort();
+		}
+		return static_cast<T*>(Memory);
+	}
+
+	void deallocate(T* Memory, size_t)
+	{
+#if defined(_MSC_VER)
+		_aligned_free(Memory);
+#else
+		free(Memory);
+#endif
+	}
+
+	template <typename U>
+	bool operator==(const TClothAlignedAllocator<U, Alignment>&) const { return true; }
+
+	template <typename U>
+	bool operator!=(const TClothAlignedAllocator<U, Alignment>&) const { return false; }
+};
+
+struct FClothVector
+{
+	float X, Y, Z;
+};
+
+/** 32 byte aligned float array, enough for AVX */
+typedef std::vector<float, TClothAlignedAllocator<float, 32>> FClothFloatArray;
+
+/**
+ * Positions stored as structure of arrays.
+ * Arrays are padded to a multiple of PaddingGranularity, so SIMD loops never need a remainder loop.
+ */
+struct FClothPositionBuffer
+{
+	static const int32_t PaddingGranularity = 8;
+
+	FClothFloatArray X;
+	FClothFloatArray Y;
+	FClothFloatArray Z;
+
+	FClothPositionBuffer()
+		: NumPositions(0)
+	{
+	}
+
+	static int32_t GetPaddedNum(int32_t Num)
+	{
+		return (Num + PaddingGranularity - 1) / PaddingGranularity * PaddingGranularity;
+	}
+
+	int32_t Num() const
+	{
+		return NumPositions;
+	}
+
+	int32_t PaddedNum() const
+	{
+		return (int32_t)X.size();
+	}
+
+	/** Resizes arrays, padding is filled with zero */
+	void SetNum(int32_t NewNum)
+	{
+		NumPositions = NewNum;
+		X.assign(GetPaddedNum(NewNum), 0.0f);
+		Y.assign(GetPaddedNum(NewNum), 0.0f);
+		Z.assign(GetPaddedNum(NewNum), 0.0f);
+	}
+
+	FClothVector Get(int32_t Index) const
+	{
+		return FClothVector{ X[Index], Y[Index], Z[Index] };
+	}
+
+	void Set(int32_t Index, const FClothVector& Position)
+	{
+		X[Index] = Position.X;
+		Y[Index] = Position.Y;
+		Z[Index] = Position.Z;
+	}
+
+private:
+	int32_t NumPositions;
+};
@@ -0,0 +1,530 @@
+// Copyright 2016 massanoori. All Rights Reserved.
+
+#pragma once
+
+// This header must not depend on the engine.
+// The solver is also built standalone with CMake for headless profiling.
+
+#include "AirMeshClothPositions.h"
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/** Affine transform applied as P' = M * (P, 1) */
+struct FClothTransform
+{
+	float M[3][4];
+
+	static FClothTransform Identity();
+
+	FClothVector TransformPosition(const FClothVector& P) const
+	{
+		return FClothVector{
+			M[0][0] * P.X + M[0][1] * P.Y + M[0][2] * P.Z + M[0][3],
+			M[1][0] * P.X + M[1][1] * P.Y + M[1][2] * P.Z + M[1][3],
+			M[2][0] * P.X + M[2][1] * P.Y + M[2][2] * P.Z + M[2][3],
+		};
+	}
+};
+
+/** Edge length constraint, packed into 16 bytes */
+struct FClothEdge
+{
+	// Fixed point 1.0 of WeightFactors
+	static const uint16_t WeightFactorOne = 1 << 15;
+
+	uint32_t VertexIndices[2];
+	float RestLength;
+
+	// Share of the correction applied to each vertex, its inverse mass divided by the sum of both
+	uint16_t WeightFactors[2];
+
+	float GetWeightFactor(int32_t Index) const
+	{
+		return WeightFactors[Index] * (1.0f / WeightFactorOne);
+	}
+};
+
+static_assert(sizeof(FClothEdge) == 16, "FClothEdge is expected to be packed");
+
+struct FClothTetrahedron
+{
+	int32_t VertexIndices[4];
+};
+
+/** External acceleration of vertices, see FAirMeshClothSolver::SetForceFields() */
+struct FClothForceField
+{
+	enum class EType : uint8_t
+	{
+		// Uniform acceleration, e.g. steady wind
+		Directional,
+
+		// Acceleration varying smoothly over space and time, by Strength at most
+		Turbulence,
+
+		// Acceleration away from the center fading out linearly to Radius, towards the center if Strength is negative
+		Radial,
+	};
+
+	EType Type;
+
+	// Acceleration of directional fields, center of radial fields
+	FClothVector Vector;
+
+	float Strength;
+
+	// Falloff radius of radial fields, wavelength of turbulence
+	float Radius;
+
+	// Turbulence changes its pattern by this in radians per second
+	float Speed;
+
+	static FClothForceField MakeDirectional(const FClothVector& Acceleration);
+	static FClothForceField MakeTurbulence(float Amplitude, float Wavelength, float Speed);
+	static FClothForceField MakeRadial(const FClothVector& Center, float Strength, float Radius);
+};
+
+/** Rectangular multi-layer grid, same parameters as UAirMeshClothComponent */
+struct FClothGridDesc
+{
+	uint32_t ResolutionX;
+	uint32_t ResolutionY;
+	float SizeX;
+	float SizeY;
+	uint32_t NumLayers;
+	float LayerInterval;
+
+	uint32_t GetNumVerticesPerLayer() const
+	{
+		return (ResolutionX + 1) * (ResolutionY + 1);
+	}
+
+	/** Rows of vertices along X in all layers, consecutive in memory */
+	uint32_t GetNumRows() const
+	{
+		return (ResolutionY + 1) * NumLayers;
+	}
+
+	uint32_t GetNumIndicesPerLayer() const
+	{
+		return ResolutionX * ResolutionY * 2 * 3;
+	}
+};
+
+struct FClothStepParams
+{
+	// Time of each substep
+	float DeltaTime;
+
+	// Substeps taken by a step, pinned vertices reach PinnedVertexTransform in the first one
+	uint32_t NumSubsteps;
+
+	float GravityZ;
+	float Damping;
+
+	// Constraint iterations of each substep, the maximum if StrainTolerance is not 0
+	uint32_t NumIterations;
+
+	// Iterations stop early after MinIterations, once no edge is strained more than StrainTolerance and no air tetrahedron is inverted
+	uint32_t MinIterations;
+	float StrainTolerance;
+
+	// Iterations of each coarse level before fine iterations, see FAirMeshClothSolver::SetNumHierarchyLevels()
+	uint32_t NumCoarseIterations;
+
+	// Inverse stiffness of XPBD constraints, independent of iterations and timestep. 0 projects rigid PBD constraints.
+	float EdgeCompliance;
+	float AirMeshCompliance;
+
+	// Spectral radius of a constraint iteration estimated for Chebyshev acceleration, in [0, 1). 0 disables acceleration.
+	float ChebyshevSpectralRadius;
+
+	bool bUseAirMesh;
+
+	// Project constraints by Jacobi iterations instead of Gauss-Seidel
+	bool bUseJacobi;
+
+	// Moves pinned vertices from the previous to the current component transform
+	FClothTransform PinnedVertexTransform;
+};
+
+/** Accumulates frame time to be simulated by fixed timesteps */
+class FClothTimeAccumulator
+{
+public:
+	FClothTimeAccumulator()
+		: AccumulatedTime(0.0f)
+	{
+	}
+
+	void Reset()
+	{
+		AccumulatedTime = 0.0f;
+	}
+
+	/** Adds frame time and returns the number of fixed timesteps to take. Time beyond MaxSubsteps is dropped. */
+	uint32_t Advance(float FrameDeltaTime, float FixedDeltaTime, uint32_t MaxSubsteps);
+
+	/** Remaining time in fixed timesteps, [0, 1), to interpolate from the previous to the current state */
+	float GetAlpha(float FixedDeltaTime) const
+	{
+		return AccumulatedTime / FixedDeltaTime;
+	}
+
+private:
+	float AccumulatedTime;
+};
+
+/**
+ * Runs Body(Index) for every Index in [0, Num), possibly in parallel, and returns when all of them have finished.
+ * The component passes ParallelFor of the engine.
+ */
+typedef std::function<void(int32_t Num, const std::function<void(int32_t Index)>& Body)> FClothParallelFor;
+
+/** Generates triangle list indices of the grid, layer by layer */
+void GenerateClothGridIndices(const FClothGridDesc& Grid, std::vector<int32_t>& OutIndices);
+
+/**
+ * Graph-colors tetrahedra by shared vertices for FAirMeshClothSolver::SetAirTetrahedra().
+ * Tetrahedra are reordered in place so that each color is contiguous.
+ *
+ * @param OutColorOffsets Start of each color, followed by NumTetrahedra
+ */
+void ColorClothTetrahedra(FClothTetrahedron* Tetrahedra, int32_t NumTetrahedra, std::vector<int32_t>& OutColorOffsets);
+
+/**
+ * Position based cloth solver with air mesh constraints.
+ * Vertices are simulated by Verlet integration, and then edge length and air tetrahedron constraints are enforced.
+ */
+class FAirMeshClothSolver
+{
+public:
+	FAirMeshClothSolver();
+
+	/**
+	 * Stores all layers of each grid point together and sorts constraints of each color by vertices,
+	 * so that air tetrahedra touch nearby memory. Edges are within layers and get a larger stride, so this pays off with many layers.
+	 * Takes effect on the next InitializeGrid().
+	 * Vertex indices taken and returned by the solver are always grid indices, they are remapped internally.
+	 */
+	void SetReorderVertices(bool bInReorderVertices);
+
+	/**
+	 * Adds coarse levels of edges, level L connecting every 2^L-th grid point of each layer.
+	 * Coarse edges only resist stretching. Each substep projects them from the coarsest level with Gauss-Seidel,
+	 * and after each level the corrections of its vertices are bilinearly interpolated to the vertices between them,
+	 * so that stretch over long distances is removed in few iterations.
+	 * Takes effect on the next InitializeGrid(), 0 disables the hierarchy.
+	 */
+	void SetNumHierarchyLevels(int32_t InNumHierarchyLevels);
+
+	/** Generates local space vertices and edges of the grid. Rest lengths are not computed yet. */
+	void InitializeGrid(const FClothGridDesc& Grid);
+
+	/** Transforms current positions, e.g. from local space to world space */
+	void TransformPositions(const FClothTransform& Transform);
+
+	/** Computes rest lengths from current positions and copies current positions to previous positions */
+	void FinalizeRestState();
+
+	/**
+	 * @param Tetrahedra Tetrahedra colored by ColorClothTetrahedra()
+	 * @param ColorOffsets Color offsets returned by ColorClothTetrahedra(), NumColors + 1 elements
+	 */
+	void SetAirTetrahedra(const FClothTetrahedron* Tetrahedra, int32_t NumTetrahedra, const int32_t* ColorOffsets, int32_t NumColors);
+
+	/**
+	 * Constraints are graph-colored, and constraints of each color are projected in parallel with this.
+	 * Results do not depend on the number of threads. Constraints are projected serially if not set.
+	 */
+	void SetParallelFor(const FClothParallelFor& InParallelFor);
+
+	/**
+	 * Air tetrahedra which cannot be inverted are skipped.
+	 * Positions are snapshotted with the list of tetrahedra that could be inverted if no vertex moves farther than a margin,
+	 * and both are rebuilt when a vertex moves beyond it. Movement is checked before every pass over air tetrahedra,
+	 * and corrections during a pass are tracked, so all tetrahedra are projected from the color where the margin is exceeded.
+	 * Results are the same as without culling. Culling is suspended for a while when the cloth moves beyond the margin on every pass.
+	 */
+	void SetCullAirTetrahedra(bool bInCullAirTetrahedra);
+
+	/**
+	 * External accelerations applied in addition to gravity until changed, regardless of vertex weights except pinned vertices.
+	 * Directional fields are summed up once. Other fields are accumulated per vertex in one vectorized pass before integration.
+	 */
+	void SetForceFields(const FClothForceField* Fields, int32_t NumFields);
+
+	/**
+	 * Fields applied in addition by the first substep of the next Step() which has substeps, then removed.
+	 * Used for impulses, which would be applied as many times as substeps otherwise.
+	 */
+	void SetFirstSubstepForceFields(const FClothForceField* Fields, int32_t NumFields);
+
+	void Step(const FClothStepParams& Params);
+
+	// Individual stages of Step(), exposed for profiling
+
+	/** Evaluates fields other than directional ones at current positions, and advances time of turbulence */
+	void EvaluateForceFields(float DeltaTime);
+	void Integrate(const FClothStepParams& Params);
+	void ProjectEdgeConstraints();
+	void ProjectAirTetrahedra();
+	void ProjectHierarchyLevels(uint32_t NumCoarseIterations);
+
+	/**
+	 * Jacobi variants of the projections. Every constraint is projected against the same positions,
+	 * its corrections are stored per constraint vertex, and then each vertex moves by the average of its corrections.
+	 * Neither pass writes to shared memory, so they run in parallel without colors nor atomics,
+	 * but converge slower than Gauss-Seidel. Air tetrahedra are not culled, and constraints are rigid regardless of compliance.
+	 */
+	void ProjectEdgeConstraintsJacobi();
+	void ProjectAirTetrahedraJacobi();
+
+	int32_t GetNumVertices() const
+	{
+		return GetCurrentPositionArray().Num();
+	}
+
+	/** Current positions, stored as structure of arrays in simulation order, see SetReorderVertices() */
+	const FClothPositionBuffer& GetPositionBuffer() const
+	{
+		return GetCurrentPositionArray();
+	}
+
+	FClothVector GetPosition(int32_t VertexIndex) const
+	{
+		return GetCurrentPositionArray().Get(GetSimulatedVertexIndex(VertexIndex));
+	}
+
+	/** Copies current positions to an array of structures, e.g. to hand them off to the renderer */
+	void CopyPositions(FClothVector* OutPositions) const;
+
+	/** Same as CopyPositions(), and transforms positions while copying */
+	void CopyPositions(FClothVector* OutPositions, const FClothTransform& Transform) const;
+
+	/**
+	 * Same as CopyPositions() with a transform, and interpolates positions before the last substep and current positions.
+	 * Alpha is 0 for positions before the last substep, and 1 for current positions.
+	 * Pinned vertices are copied without interpolation, since their previous positions were pinned by the previous transform.
+	 */
+	void CopyInterpolatedPositions(FClothVector* OutPositions, const FClothTransform& Transform, float Alpha) const;
+
+	void CalcBounds(FClothVector& OutMin, FClothVector& OutMax) const;
+
+	/** Largest distance a vertex has moved in the last substep, used to detect settled cloth */
+	float CalcMaxStepDisplacement() const;
+
+	/** Largest |CurrentLength - RestLength| / CurrentLength of edges found by the last edge pass, before correcting them */
+	float GetMaxEdgeStrain() const
+	{
+		return MaxEdgeStrain;
+	}
+
+	/** Inverted air tetrahedra found by the last air tetrahedron pass, before correcting them */
+	int32_t GetNumInvertedAirTetrahedra() const
+	{
+		return NumInvertedAirTetrahedra;
+	}
+
+	/** Constraint iterations taken by the last Step() over all substeps, fewer than requested if stopped early */
+	uint32_t GetNumIterationsOfLastStep() const
+	{
+		return NumIterationsOfLastStep;
+	}
+
+	/**
+	 * Largest distance a vertex was moved by the projections of the last constraint iteration of Step(),
+	 * which approaches 0 as iterations converge. Measured only with Chebyshev acceleration, 0 otherwise.
+	 */
+	float GetLastIterationDisplacement() const
+	{
+		return LastIterationDisplacement;
+	}
+
+	/** Edges referring to vertices in simulation order */
+	const std::vector<FClothEdge>& GetEdges() const
+	{
+		return ClothEdges;
+	}
+
+	int32_t GetNumHierarchyLevels() const
+	{
+		return (int32_t)HierarchyLevels.size();
+	}
+
+	int32_t GetNumEdgeColors() const
+	{
+		return (int32_t)EdgeColorOffsets.size() - 1;
+	}
+
+	int32_t GetNumAirTetrahedronColors() const
+	{
+		return (int32_t)AirTetrahedronColorOffsets.size() - 1;
+	}
+
+	/** Number of air tetrahedra projected by the last pass */
+	int32_t GetNumActiveAirTetrahedra() const
+	{
+		return NumActiveAirTetrahedra;
+	}
+
+	/** Air tetrahedra referring to vertices in simulation order */
+	const std::vector<FClothTetrahedron>& GetAirTetrahedra() const
+	{
+		return AirTetrahedra;
+	}
+
+private:
+	FClothPositionBuffer SimulatedPositions[2];
+	FClothFloatArray SimulatedWeights;
+	std::vector<FClothEdge> ClothEdges;
+	std::vector<FClothTetrahedron> AirTetrahedra;
+	int32_t CurrentPositionArrayIndex;
+
+	// Simulation order index of each grid vertex, empty if vertices are not reordered
+	bool bReorderVertices;
+	std::vector<int32_t> GridToSimulatedVertex;
+
+	int32_t GetSimulatedVertexIndex(int32_t GridVertexIndex) const
+	{
+		return GridToSimulatedVertex.empty() ? GridVertexIndex : GridToSimulatedVertex[GridVertexIndex];
+	}
+
+	void ReorderVertices(const FClothGridDesc& Grid);
+
+	/** Coarse edges between a subset of vertices, see SetNumHierarchyLevels() */
+	struct FHierarchyLevel
+	{
+		std::vector<FClothEdge> Edges;
+		std::vector<int32_t> EdgeColorOffsets;
+
+		// Vertices of the level, and their positions before projecting the level and then corrections
+		std::vector<int32_t> Vertices;
+		std::vector<FClothVector> Corrections;
+
+		/** Vertex between level vertices, Corners are indices into Vertices */
+		struct FProlongation
+		{
+			int32_t VertexIndex;
+			int32_t Corners[4];
+			float Weights[4];
+		};
+
+		// Pinned vertices are left out
+		std::vector<FProlongation> Prolongations;
+	};
+
+	int32_t NumHierarchyLevels;
+	std::vector<FHierarchyLevel> HierarchyLevels;
+
+	void BuildHierarchyLevels(const FClothGridDesc& Grid);
+	void ProjectHierarchyLevel(FHierarchyLevel& Level, uint32_t NumIterations);
+
+	// Edges of a color share no vertices. Offsets of colors in ClothEdges, followed by the number of edges.
+	std::vector<int32_t> EdgeColorOffsets;
+	std::vector<int32_t> AirTetrahedronColorOffsets;
+
+	FClothParallelFor ParallelFor;
+
+	// Force fields, see SetForceFields(). Accelerations are evaluated only if there is a field varying over vertices.
+	std::vector<FClothForceField> ForceFields;
+	std::vector<FClothForceField> FirstSubstepForceFields;
+	std::vector<FClothForceField> ActiveForceFields;
+	FClothVector UniformAcceleration;
+	bool bHasVaryingForceFields;
+	double ForceFieldTime;
+	std::vector<float> ForceFieldPhases;
+	FClothPositionBuffer ExternalAccelerations;
+
+	/** Combines fields of both lists into ActiveForceFields */
+	void UpdateActiveForceFields();
+
+	// XPBD compliance divided by squared substep time, set by Step(), and Lagrange multipliers accumulated over a substep.
+	// Air tetrahedra are not culled with compliance, since multipliers are indexed by AirTetrahedra.
+	float EdgeAlphaTilde;
+	float AirTetrahedronAlphaTilde;
+	std::vector<float> EdgeLambdas;
+	std::vector<float> AirTetrahedronLambdas;
+
+	// Air tetrahedra culling, see SetCullAirTetrahedra()
+	bool bCullAirTetrahedra;
+	bool bActiveAirTetrahedraValid;
+	float AirTetrahedronCullingMargin;
+	int32_t NumPassesSinceCullingUpdate;
+	int32_t NumPassesToSkipCulling;
+	int32_t NumActiveAirTetrahedra;
+	FClothPositionBuffer CullingReferencePositions;
+	std::vector<float> AirTetrahedronSlacks;
+	std::vector<FClothTetrahedron> ActiveAirTetrahedra;
+	std::vector<int32_t> ActiveAirTetrahedronColorOffsets;
+
+	/** Returns false if all air tetrahedra have to be projected, otherwise the largest displacement from the reference */
+	bool UpdateActiveAirTetrahedra(float& OutDisplacementSquared);
+
+	struct FJacobiDelta
+	{
+		FClothVector Correction;
+
+		// 1 if the constraint moved the vertex, corrections are averaged by the sum of these
+		float Count;
+	};
+
+	/** Correction slots of a kind of constraints, constraint vertex Vertex of constraint Index uses slot Index * NumConstraintVertices + Vertex */
+	struct FJacobiBuffer
+	{
+		std::vector<FJacobiDelta> Deltas;
+
+		// Slots of each vertex, VertexSlots[VertexSlotOffsets[VertexIndex]] to VertexSlots[VertexSlotOffsets[VertexIndex + 1] - 1]
+		std::vector<int32_t> VertexSlotOffsets;
+		std::vector<int32_t> VertexSlots;
+	};
+
+	// Built on the first Jacobi projection
+	FJacobiBuffer EdgeJacobiBuffer;
+	FJacobiBuffer AirTetrahedronJacobiBuffer;
+
+	void ApplyJacobiDeltas(const FJacobiBuffer& Buffer);
+
+	/** Splits [Begin, End) into batches and runs RangeBody(BatchBegin, BatchEnd) for each, in parallel if possible */
+	void ForEachBatch(int32_t Begin, int32_t End, const std::function<void(int32_t, int32_t)>& RangeBody) const;
+
+	// Convergence of the last passes, see GetMaxEdgeStrain()
+	float MaxEdgeStrain;
+	int32_t NumInvertedAirTetrahedra;
+	uint32_t NumIterationsOfLastStep;
+
+	/** Returns the largest edge strain in the range */
+	float ProjectEdgeConstraints(int32_t Begin, int32_t End);
+	float ProjectEdgeConstraintsCompliant(int32_t Begin, int32_t End);
+
+	// Latest and previous iterates of Chebyshev acceleration
+	FClothPositionBuffer IterationPositions[2];
+	float LastIterationDisplacement;
+
+	/** Extrapolates projected positions from the previous iterate by Omega, and rotates iterates */
+	void AccelerateIteration(float Omega);
+	/** Returns the number of inverted tetrahedra, and the largest displacement of corrected vertices from CullingReferencePositions if requested */
+	int32_t ProjectAirTetrahedra(const FClothTetrahedron* Tetrahedra, int32_t Begin, int32_t End, float* OutMaxDisplacementSquared = nullptr);
+
+	FClothPositionBuffer& GetCurrentPositionArray()
+	{
+		return SimulatedPositions[CurrentPositionArrayIndex];
+	}
+
+	const FClothPositionBuffer& GetCurrentPositionArray() const
+	{
+		return SimulatedPositions[CurrentPositionArrayIndex];
+	}
+
+	FClothPositionBuffer& GetPreviousPositionArray()
+	{
+		return SimulatedPositions[CurrentPositionArrayIndex ^ 1];
+	}
+
+	const FClothPositionBuffer& GetPreviousPositionArray() const
+	{
+		return SimulatedPositions[CurrentPositionArrayIndex ^ 1];
+	}
+};
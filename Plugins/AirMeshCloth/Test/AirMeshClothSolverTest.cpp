@@ -0,0 +1,189 @@
+// Copyright 2016 massanoori. All Rights Reserved.
+
+// Regression tests of the engine-independent cloth solver, run by CTest.
+// Optimizations documented to keep results the same are compared bit for bit against the plain solver on a moving cloth.
+// Runs all tests, or the one named by the first argument.
+
+#include "AirMeshClothSolver.h"
+#include "AirMeshClothTestScene.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace
+{
+	const int32_t NumSteps = 120;
+
+	FClothGridDesc MakeTestGridDesc()
+	{
+		return MakeGridDesc(32, 4);
+	}
+
+	/** Translation of the component. Vertices move beyond the culling margin now and then, so culled lists are both used and rebuilt. */
+	FClothVector GetComponentTranslation(int32_t StepIndex)
+	{
+		return FClothVector{ 2.0f * std::sin(StepIndex * 0.3f), 0.0f, 1.5f * std::cos(StepIndex * 0.4f) };
+	}
+
+	FClothTransform MakeTranslation(const FClothVector& Translation)
+	{
+		FClothTransform Transform = FClothTransform::Identity();
+		Transform.M[0][3] = Translation.X;
+		Transform.M[1][3] = Translation.Y;
+		Transform.M[2][3] = Translation.Z;
+		return Transform;
+	}
+
+	/** Pinned vertices are moved by the motion of the component since the last step, same as UAirMeshClothComponent::PrepareStep */
+	FClothTransform MakePinnedVertexTransform(int32_t StepIndex)
+	{
+		const FClothVector Current = GetComponentTranslation(StepIndex);
+		const FClothVector Previous = GetComponentTranslation(StepIndex - 1);
+		return MakeTranslation(FClothVector{ Current.X - Previous.X, Current.Y - Previous.Y, Current.Z - Previous.Z });
+	}
+
+	/** Steps a swinging cloth, and returns positions in grid order */
+	std::vector<FClothVector> SimulateMovingCloth(FAirMeshClothSolver& Solver)
+	{
+		auto Params = MakeStepParams(4);
+		for (int32_t StepIndex = 1; StepIndex <= NumSteps; StepIndex++)
+		{
+			Params.PinnedVertexTransform = MakePinnedVertexTransform(StepIndex);
+			Solver.Step(Params);
+		}
+
+		std::vector<FClothVector> Positions(Solver.GetNumVertices());
+		Solver.CopyPositions(Positions.data());
+		return Positions;
+	}
+
+	bool ArePositionsIdentical(const std::vector<FClothVector>& Expected, const std::vector<FClothVector>& Actual)
+	{
+		return Expected.size() == Actual.size()
+			&& std::memcmp(Expected.data(), Actual.data(), Expected.size() * sizeof(FClothVector)) == 0;
+	}
+
+	bool TestCulledAirTetrahedra()
+	{
+		const auto Grid = MakeTestGridDesc();
+
+		auto Solver = CreateSceneSolver(Grid);
+		auto CulledSolver = CreateSceneSolver(Grid);
+		CulledSolver->SetCullAirTetrahedra(true);
+
+		return ArePositionsIdentical(SimulateMovingCloth(*Solver), SimulateMovingCloth(*CulledSolver));
+	}
+
+	bool TestReorderedVertices()
+	{
+		const auto Grid = MakeTestGridDesc();
+
+		auto Solver = CreateSceneSolver(Grid);
+		auto ReorderedSolver = CreateSceneSolver(Grid, true);
+
+		return ArePositionsIdentical(SimulateMovingCloth(*Solver), SimulateMovingCloth(*ReorderedSolver));
+	}
+
+	bool TestParallelFor()
+	{
+		const auto Grid = MakeTestGridDesc();
+
+		auto Solver = CreateSceneSolver(Grid);
+		auto ParallelSolver = CreateSceneSolver(Grid);
+		ParallelSolver->SetParallelFor(MakeThreadParallelFor(4));
+
+		return ArePositionsIdentical(SimulateMovingCloth(*Solver), SimulateMovingCloth(*ParallelSolver));
+	}
+
+	/**
+	 * Render positions are interpolated between substeps with a fixed timestep, and copied by the current transform of the component.
+	 * Pinned vertices must stay at their rest positions relative to the component, even while it moves.
+	 */
+	bool TestPinnedInterpolatedPositions()
+	{
+		const auto Grid = MakeTestGridDesc();
+		auto Solver = CreateSceneSolver(Grid);
+
+		std::vector<FClothVector> RestPositions(Solver->GetNumVertices());
+		Solver->CopyPositions(RestPositions.data());
+
+		// Pinned vertices reach the transform in the first substep, so they are interpolated only with a single substep
+		auto Params = MakeStepParams(4);
+
+		std::vector<FClothVector> RenderPositions(Solver->GetNumVertices());
+		for (int32_t StepIndex = 1; StepIndex <= NumSteps; StepIndex++)
+		{
+			Params.PinnedVertexTransform = MakePinnedVertexTransform(StepIndex);
+			Solver->Step(Params);
+
+			// The solver starts at the translation of step 0, so world to component is the inverse of the translation since then
+			const FClothVector Current = GetComponentTranslation(StepIndex);
+			const FClothVector Initial = GetComponentTranslation(0);
+			const FClothTransform WorldToComponent = MakeTranslation(FClothVector{ Initial.X - Current.X, Initial.Y - Current.Y, Initial.Z - Current.Z });
+			Solver->CopyInterpolatedPositions(RenderPositions.data(), WorldToComponent, 0.5f);
+
+			// First row of each layer is pinned
+			for (uint32_t Layer = 0; Layer < Grid.NumLayers; Layer++)
+			{
+				for (uint32_t XIndex = 0; XIndex <= Grid.ResolutionX; XIndex++)
+				{
+					const uint32_t VertexIndex = Layer * Grid.GetNumVerticesPerLayer() + XIndex;
+					const FClothVector& Expected = RestPositions[VertexIndex];
+					const FClothVector& Actual = RenderPositions[VertexIndex];
+					if (std::fabs(Expected.X - Actual.X) + std::fabs(Expected.Y - Actual.Y) + std::fabs(Expected.Z - Actual.Z) > 1.0e-3f)
+					{
+						return false;
+					}
+				}
+			}
+		}
+
+		return true;
+	}
+
+	struct FSolverTest
+	{
+		const char* Name;
+		bool (*Run)();
+	};
+
+	const FSolverTest SolverTests[] =
+	{
+		{ "CulledAirTetrahedra", TestCulledAirTetrahedra },
+		{ "ReorderedVertices", TestReorderedVertices },
+		{ "ParallelFor", TestParallelFor },
+		{ "PinnedInterpolatedPositions", TestPinnedInterpolatedPositions },
+	};
+}
+
+int main(int argc, char** argv)
+{
+	const char* TestName = argc > 1 ? argv[1] : nullptr;
+
+	int32_t NumRun = 0;
+	int32_t NumFailed = 0;
+	for (const auto& Test : SolverTests)
+	{
+		if (TestName && std::strcmp(TestName, Test.Name) != 0)
+		{
+			continue;
+		}
+
+		const bool bPassed = Test.Run();
+		std::printf("%s: %s\n", Test.Name, bPassed ? "passed" : "FAILED");
+
+		NumRun++;
+		NumFailed += bPassed ? 0 : 1;
+	}
+
+	if (NumRun == 0)
+	{
+		std::printf("Unknown test: %s\n", TestName);
+		return 1;
+	}
+
+	return NumFailed > 0 ? 1 : 0;
+}
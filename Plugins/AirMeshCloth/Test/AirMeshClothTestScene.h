@@ -0,0 +1,172 @@
+// Copyright 2016 massanoori. All Rights Reserved.
+
+// Cloth scenes shared by the solver tests and microbenchmarks.
+
+#pragma once
+
+#include "AirMeshClothSolver.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+inline FClothGridDesc MakeGridDesc(int32_t Resolution, int32_t NumLayers)
+{
+	FClothGridDesc Grid;
+	Grid.ResolutionX = Resolution;
+	Grid.ResolutionY = Resolution;
+	Grid.SizeX = 100.0f;
+	Grid.SizeY = 100.0f;
+	Grid.NumLayers = NumLayers;
+	Grid.LayerInterval = 5.0f;
+	return Grid;
+}
+
+inline FClothStepParams MakeStepParams(uint32_t NumIterations)
+{
+	FClothStepParams Params;
+	Params.DeltaTime = 1.0f / 60.0f;
+	Params.NumSubsteps = 1;
+	Params.GravityZ = -980.0f;
+	Params.Damping = 0.01f;
+	Params.NumIterations = NumIterations;
+	Params.MinIterations = NumIterations;
+	Params.StrainTolerance = 0.0f;
+	Params.NumCoarseIterations = 0;
+	Params.EdgeCompliance = 0.0f;
+	Params.AirMeshCompliance = 0.0f;
+	Params.ChebyshevSpectralRadius = 0.0f;
+	Params.bUseAirMesh = true;
+	Params.bUseJacobi = false;
+	Params.PinnedVertexTransform = FClothTransform::Identity();
+	return Params;
+}
+
+inline float SignedVolume(const FClothVector* Positions, const FClothTetrahedron& Tet)
+{
+	const auto& P3 = Positions[Tet.VertexIndices[3]];
+	const auto& P0 = Positions[Tet.VertexIndices[0]];
+	const auto& P1 = Positions[Tet.VertexIndices[1]];
+	const auto& P2 = Positions[Tet.VertexIndices[2]];
+
+	float A[3] = { P0.X - P3.X, P0.Y - P3.Y, P0.Z - P3.Z };
+	float B[3] = { P1.X - P3.X, P1.Y - P3.Y, P1.Z - P3.Z };
+	float C[3] = { P2.X - P3.X, P2.Y - P3.Y, P2.Z - P3.Z };
+
+	return
+		A[0] * (B[1] * C[2] - B[2] * C[1]) +
+		A[1] * (B[2] * C[0] - B[0] * C[2]) +
+		A[2] * (B[0] * C[1] - B[1] * C[0]);
+}
+
+/**
+ * TetGen is not available on headless machines, so air between adjacent layers is filled
+ * by splitting every grid cell into 6 tetrahedra, which is close to what TetGen generates.
+ */
+inline std::vector<FClothTetrahedron> GenerateLayeredAirTetrahedra(const FClothGridDesc& Grid, const FClothVector* Positions)
+{
+	static const int32_t KuhnTetrahedra[6][4] =
+	{
+		{ 0, 1, 3, 7 },
+		{ 0, 1, 5, 7 },
+		{ 0, 2, 3, 7 },
+		{ 0, 2, 6, 7 },
+		{ 0, 4, 5, 7 },
+		{ 0, 4, 6, 7 },
+	};
+
+	const uint32_t RowStride = Grid.ResolutionX + 1;
+	const uint32_t LayerStride = Grid.GetNumVerticesPerLayer();
+
+	std::vector<FClothTetrahedron> Tetrahedra;
+	if (Grid.NumLayers < 2)
+	{
+		return Tetrahedra;
+	}
+	Tetrahedra.reserve(Grid.ResolutionX * Grid.ResolutionY * (Grid.NumLayers - 1) * 6);
+
+	for (uint32_t Layer = 0; Layer + 1 < Grid.NumLayers; Layer++)
+	{
+		for (uint32_t YIndex = 0; YIndex < Grid.ResolutionY; YIndex++)
+		{
+			for (uint32_t XIndex = 0; XIndex < Grid.ResolutionX; XIndex++)
+			{
+				int32_t Base = Layer * LayerStride + YIndex * RowStride + XIndex;
+				int32_t Corners[8];
+				for (int32_t Corner = 0; Corner < 8; Corner++)
+				{
+					Corners[Corner] = Base
+						+ ((Corner & 1) ? 1 : 0)
+						+ ((Corner & 2) ? RowStride : 0)
+						+ ((Corner & 4) ? LayerStride : 0);
+				}
+
+				for (const auto& Kuhn : KuhnTetrahedra)
+				{
+					FClothTetrahedron Tet;
+					for (int32_t Vertex = 0; Vertex < 4; Vertex++)
+					{
+						Tet.VertexIndices[Vertex] = Corners[Kuhn[Vertex]];
+					}
+					if (SignedVolume(Positions, Tet) < 0.0f)
+					{
+						std::swap(Tet.VertexIndices[2], Tet.VertexIndices[3]);
+					}
+					Tetrahedra.push_back(Tet);
+				}
+			}
+		}
+	}
+
+	return Tetrahedra;
+}
+
+/** Stands in for ParallelFor of the engine, threads are spawned on every call */
+inline FClothParallelFor MakeThreadParallelFor(int32_t NumThreads)
+{
+	return [NumThreads](int32_t Num, const std::function<void(int32_t)>& Body)
+	{
+		std::atomic<int32_t> NextIndex(0);
+		auto Worker = [&NextIndex, Num, &Body]()
+		{
+			for (int32_t Index = NextIndex++; Index < Num; Index = NextIndex++)
+			{
+				Body(Index);
+			}
+		};
+
+		std::vector<std::thread> Threads;
+		for (int32_t ThreadIndex = 1; ThreadIndex < NumThreads; ThreadIndex++)
+		{
+			Threads.emplace_back(Worker);
+		}
+		Worker();
+		for (auto& Thread : Threads)
+		{
+			Thread.join();
+		}
+	};
+}
+
+/** Solver with air tetrahedra between all layers, built in the same order as UAirMeshClothComponent::OnRegister */
+inline std::unique_ptr<FAirMeshClothSolver> CreateSceneSolver(const FClothGridDesc& Grid, bool bReorderVertices = false, int32_t NumHierarchyLevels = 0)
+{
+	std::unique_ptr<FAirMeshClothSolver> Solver(new FAirMeshClothSolver());
+	Solver->SetReorderVertices(bReorderVertices);
+	Solver->SetNumHierarchyLevels(NumHierarchyLevels);
+	Solver->InitializeGrid(Grid);
+	Solver->TransformPositions(FClothTransform::Identity());
+	Solver->FinalizeRestState();
+
+	std::vector<FClothVector> Positions(Solver->GetNumVertices());
+	Solver->CopyPositions(Positions.data());
+
+	auto Tetrahedra = GenerateLayeredAirTetrahedra(Grid, Positions.data());
+	std::vector<int32_t> ColorOffsets;
+	ColorClothTetrahedra(Tetrahedra.data(), (int32_t)Tetrahedra.size(), ColorOffsets);
+	Solver->SetAirTetrahedra(Tetrahedra.data(), (int32_t)Tetrahedra.size(), ColorOffsets.data(), (int32_t)ColorOffsets.size() - 1);
+
+	return Solver;
+}